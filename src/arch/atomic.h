@@ -49,6 +49,7 @@ typedef struct { volatile unsigned int lock; } spinlock_t;
 
 bool CAS_x86(volatile unsigned long long *ptr, unsigned long long oldVal, unsigned long long newVal);
 bool iCAS_x86(volatile unsigned int *ptr, unsigned int oldVal, unsigned int newVal);
+unsigned long long XCHG_x86(volatile unsigned long long *ptr, unsigned long long newVal);
 int atomic_test_and_set_x86(int *);
 int atomic_test_and_reset_x86(int *);
 void atomic_add_x86(atomic_t *, int);
@@ -68,6 +69,7 @@ void spin_lock_x86(spinlock_t *s);
 
 #define CAS			CAS_x86
 #define iCAS			iCAS_x86
+#define XCHG			XCHG_x86
 #define atomic_test_and_set	atomic_test_and_set_x86
 #define atomic_test_and_reset	atomic_test_and_reset_x86
 #define atomic_add		atomic_add_x86
@@ -55,7 +55,7 @@ static void *__helper_create_thread(void *arg) {
 
 	struct _helper_thread *real_arg = (struct _helper_thread *)arg;
 
-	// Get a unique local thread id...
+	// Get a unique local thread id
 	unsigned int old_counter;
 	unsigned int local_tid;
 
@@ -67,8 +67,8 @@ static void *__helper_create_thread(void *arg) {
 		}
 	}
 
-	// ...and make it globally unique
-	tid = (kid << (sizeof(unsigned int) * 8 / 2)) | local_tid;
+	// Thread ids are local to the kernel instance, as they are used to index per-thread data
+	tid = local_tid;
 
 	// Now get into the real thread's entry point
 	real_arg->start_routine(real_arg->arg);
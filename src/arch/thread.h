@@ -33,7 +33,7 @@
 #include <arch/os.h>
 
 /// This macro expands to true if the current KLT is the master thread for the local kernel
-#define master_thread() ((tid & ((1 << sizeof(unsigned int) * 8 / 2)-1)) == 0)
+#define master_thread() (tid == 0)
 
 
 /// This structure is used to call the thread creation helper function
@@ -0,0 +1,211 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+* @file ult-bench.c
+* @brief Microbenchmark of the ULT context switch. A kernel context and a user-level
+*        thread bounce control back and forth, and the cost of a round trip is measured
+*        both with set_jmp()/long_jmp() from jmp.S and with glibc's setjmp()/longjmp(),
+*        which is what context_switch() used before. The thread is created with the
+*        same signal stack trick as context_create() in ult.c.
+*        This is not part of the default build: run "make ult-bench" in src/.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <time.h>
+#include <arch/ult.h>
+
+
+#if defined(ENABLE_ULT) && defined(OS_LINUX) && defined(ARCH_X86_64)
+
+
+/// Number of round trips timed for each implementation, if not given on the command line
+#define ROUND_TRIPS	10000000UL
+
+/// Number of untimed round trips run before the measurement
+#define WARMUP_TRIPS	10000UL
+
+/// Stack size of the user-level thread
+#define BENCH_STACK_SIZE	(64 * 1024)
+
+
+/// The same as context_switch(), on top of glibc
+#define glibc_context_switch(context_old, context_new) \
+	if(setjmp(context_old) == 0) \
+		longjmp(context_new, 1)
+
+
+static LP_context_t	ult_kernel, ult_thread;
+static jmp_buf		glibc_kernel, glibc_thread;
+
+
+static void ult_thread_body(void) {
+	while(true) {
+		context_switch(&ult_thread, &ult_kernel);
+	}
+}
+
+static void glibc_thread_body(void) {
+	while(true) {
+		glibc_context_switch(glibc_thread, glibc_kernel);
+	}
+}
+
+
+/**
+* Signal handlers running on the thread stack. They save the context and return;
+* when the context is later restored, the thread enters its body.
+*/
+static void ult_thread_create(int sig) {
+	(void)sig;
+	if(set_jmp(&ult_thread) != 0)
+		ult_thread_body();
+}
+
+static void glibc_thread_create(int sig) {
+	(void)sig;
+	if(setjmp(glibc_thread) != 0)
+		glibc_thread_body();
+}
+
+
+/**
+* Run a signal handler on a newly allocated stack, so that the context it saves
+* can be used as a user-level thread.
+*
+* @param handler The signal handler saving the thread context
+*/
+static void thread_create(void (*handler)(int)) {
+	struct sigaction sa, osa;
+	stack_t ss, oss;
+
+	ss.ss_sp = malloc(BENCH_STACK_SIZE);
+	if(ss.ss_sp == NULL) {
+		fprintf(stderr, "Unable to allocate the thread stack\n");
+		exit(EXIT_FAILURE);
+	}
+	ss.ss_size = BENCH_STACK_SIZE;
+	ss.ss_flags = 0;
+	sigaltstack(&ss, &oss);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handler;
+	sa.sa_flags = SA_ONSTACK;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, &osa);
+
+	raise(SIGUSR1);
+
+	sigaction(SIGUSR1, &osa, NULL);
+	ss.ss_flags = SS_DISABLE;
+	sigaltstack(&ss, NULL);
+	if(!(oss.ss_flags & SS_DISABLE))
+		sigaltstack(&oss, NULL);
+}
+
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+
+static double ult_bench(unsigned long trips) {
+	struct timespec start, end;
+	unsigned long i;
+
+	thread_create(ult_thread_create);
+
+	for(i = 0; i < WARMUP_TRIPS; i++) {
+		context_switch(&ult_kernel, &ult_thread);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < trips; i++) {
+		context_switch(&ult_kernel, &ult_thread);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return elapsed_ns(&start, &end) / trips;
+}
+
+
+static double glibc_bench(unsigned long trips) {
+	struct timespec start, end;
+	unsigned long i;
+
+	thread_create(glibc_thread_create);
+
+	for(i = 0; i < WARMUP_TRIPS; i++) {
+		glibc_context_switch(glibc_kernel, glibc_thread);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < trips; i++) {
+		glibc_context_switch(glibc_kernel, glibc_thread);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return elapsed_ns(&start, &end) / trips;
+}
+
+
+int main(int argc, char **argv) {
+	unsigned long trips = ROUND_TRIPS;
+	double ult_ns, glibc_ns;
+
+	if(argc > 1) {
+		trips = strtoul(argv[1], NULL, 10);
+		if(trips == 0) {
+			fprintf(stderr, "Usage: %s [round trips]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	ult_ns = ult_bench(trips);
+	glibc_ns = glibc_bench(trips);
+
+	printf("Round trips:            %lu\n", trips);
+#ifdef ULT_SAVE_FPU
+	printf("FPU control state:      saved\n");
+#else
+	printf("FPU control state:      not saved\n");
+#endif
+	printf("set_jmp/long_jmp:       %.2f ns per round trip\n", ult_ns);
+	printf("glibc setjmp/longjmp:   %.2f ns per round trip\n", glibc_ns);
+	printf("Speedup:                %.2fx\n", glibc_ns / ult_ns);
+
+	return EXIT_SUCCESS;
+}
+
+
+#else
+
+
+int main(void) {
+	printf("set_jmp/long_jmp are available only on x86-64 Linux with ULTs enabled\n");
+	return EXIT_SUCCESS;
+}
+
+
+#endif
@@ -36,6 +36,31 @@
 
 #if defined(OS_LINUX)
 
+#if defined(ARCH_X86_64)
+
+/// This structure is used to maintain execution context for LPs' userspace threads. Its layout must match jmp.S
+struct __execution_context_t {
+	unsigned long long rip;
+	unsigned long long rsp;
+	unsigned long long rbx;
+	unsigned long long rbp;
+	unsigned long long r12;
+	unsigned long long r13;
+	unsigned long long r14;
+	unsigned long long r15;
+	unsigned int mxcsr;
+	unsigned short fpucw;
+};
+
+typedef struct __execution_context_t LP_context_t;
+typedef struct __execution_context_t kernel_context_t;
+
+// In jmp.S
+extern int set_jmp(LP_context_t *context) __attribute__((returns_twice));
+extern void long_jmp(LP_context_t *context, int val) __attribute__((noreturn));
+
+#else /* ARCH_X86_64 */
+
 #include <setjmp.h>
 
 /// This structure is used to maintain execution context for LPs' userspace threads
@@ -46,20 +71,25 @@ struct __execution_context_t {
 typedef struct __execution_context_t LP_context_t;
 typedef struct __execution_context_t kernel_context_t;
 
+#define set_jmp(context)	setjmp((context)->jb)
+#define long_jmp(context, val)	longjmp((context)->jb, val)
+
+#endif /* ARCH_X86_64 */
+
 
 
 /// Save machine context for userspace context switch. This is used only in initialization.
-#define context_save(context)  setjmp((context)->jb)
+#define context_save(context)  set_jmp(context)
 
 
 /// Restore machine context for userspace context switch. This is used only in inizialitaion.
-#define context_restore(context)  longjmp((context)->jb, 1)
+#define context_restore(context)  long_jmp(context, 1)
 
 
 /// Swicth machine context for userspace context switch. This is used to schedule a LP or return control to simulation kernel
 #define context_switch(context_old, context_new) \
-	if(setjmp((context_old)->jb) == 0) \
-		longjmp((context_new)->jb, 1)
+	if(set_jmp(context_old) == 0) \
+		long_jmp(context_new, 1)
 
 
 /// Swicth machine context for userspace context switch. This is used to schedule a LP or return control to simulation kernel
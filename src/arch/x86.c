@@ -92,6 +92,27 @@ bool iCAS_x86(volatile unsigned int *ptr, unsigned int oldVal, unsigned int newV
 }
 
 
+/**
+* This function implements an atomic exchange operation on x86-64 for long long values
+*
+* @param ptr the address where to perform the exchange on
+* @param newVal the new value to place in ptr
+*
+* @ret the value which was in ptr before the exchange
+*/
+unsigned long long XCHG_x86(volatile unsigned long long *ptr, unsigned long long newVal) {
+
+	__asm__ __volatile__(
+		"xchgq %0, %1;" // xchg with a memory operand is implicitly locked
+		: "=r"(newVal), "+m"(*ptr)
+		: "0"(newVal)
+		: "memory"
+	);
+
+	return newVal;
+}
+
+
 /**
 * This function implements the atomic_test_and_set on an integer value, for x86-64 archs
 *
@@ -41,9 +41,6 @@
 /// This is the function pointer to correctly set ScheduleNewEvent API version, depending if we're running serially or parallelly
 void (* ScheduleNewEvent)(unsigned int gid_receiver, simtime_t timestamp, unsigned int event_type, void *event_content, unsigned int event_size);
 
-/// Buffer used by MPI for outgoing messages
-//static char buff[SLOTS * sizeof(msg_t)];
-
 
 /**
 * This function initializes the communication subsystem
@@ -51,7 +48,7 @@ void (* ScheduleNewEvent)(unsigned int gid_receiver, simtime_t timestamp, unsign
 * @author Roberto Vitali
 */
 void communication_init(void) {
-//	windows_init();
+	windows_init();
 }
 
 
@@ -62,6 +59,7 @@ void communication_init(void) {
 *
 */
 void communication_fini(void) {
+	windows_fini();
 }
 
 
@@ -119,15 +117,52 @@ void ParallelScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, un
 		event.rendezvous_mark = current_evt->rendezvous_mark;
 	}
 
-	if(event_size > MAX_EVENT_SIZE) {
-		rootsim_error(true, "Event size (%d) exceeds MAX_EVENT_SIZE\n", event_size);
-	}
+	msg_set_content(&event, event_content, event_size);
+
+	insert_outgoing_msg(&event);
+}
+
+
+
+/**
+* Copy a payload into a message. Small payloads are kept inline into the
+* message, while large ones are placed into an out-of-line buffer which
+* is owned by the message and travels with it across queues, until it is
+* released by msg_release_content().
+*
+* @param msg The message which will carry the payload
+* @param content The payload (can be NULL)
+* @param size The size of the payload, in bytes
+*/
+void msg_set_content(msg_t *msg, void *content, unsigned int size) {
+	char *dest = msg->inline_content;
 
-	if (event_content != NULL) {
-		memcpy(&event.event_content, event_content, event_size);
+	msg->extra_content = NULL;
+
+	if(content == NULL || size == 0)
+		return;
+
+	if(size > INLINE_EVENT_SIZE) {
+		msg->extra_content = rsalloc(size);
+		dest = msg->extra_content;
 	}
 
-	insert_outgoing_msg(&event);
+	memcpy(dest, content, size);
+}
+
+
+
+/**
+* Release the out-of-line payload of a message (if any). This must be called
+* right before the last copy of a message is discarded.
+*
+* @param msg The message whose payload is released
+*/
+void msg_release_content(msg_t *msg) {
+	if(msg->extra_content != NULL) {
+		rsfree(msg->extra_content);
+		msg->extra_content = NULL;
+	}
 }
 
 
@@ -201,6 +236,7 @@ int comm_finalize(void) {
 	// Release as well memory used for remaining input/output queues
 	for(i = 0; i < n_prc; i++) {
 		while(!list_empty(LPS[i]->queue_in)) {
+			msg_release_content(list_head(LPS[i]->queue_in));
 			list_pop(LPS[i]->queue_in);
 		}
 		while(!list_empty(LPS[i]->queue_out)) {
@@ -215,18 +251,55 @@ int comm_finalize(void) {
 
 
 
+/**
+* A barrier across all kernel instances, whatever the transport connecting them.
+* It must be called by only one thread per kernel.
+*/
+void kernels_barrier(void) {
+#ifdef HAVE_MPI
+	if(mpi_is_initialized) {
+		mpi_barrier();
+		return;
+	}
+#endif
+	shm_barrier();
+}
+
+
+
 /**
 * Send a message. If it's scheduled to a local LP, update its queue, otherwise
-* ask MPI to deliver it to the hosting kernel instance.
+* hand it to the transport towards the hosting kernel instance: MPI, if kernels
+* are the ranks of an MPI job, or the shared memory ring.
 *
 * @author Francesco Quaglia
 */
 void Send(msg_t *msg) {
+	// The single-pass GVT reduction accounts for the messages sent since each thread's report
+	gvt_message_sent(msg->timestamp);
+
 	// Check whether the message recepient is local or remote
 	if(GidToKernel(msg->receiver) == kid) { // is local
 		insert_bottom_half(msg);
 	} else { // is remote
-		rootsim_error(true, "Calling an operation not yet reimplemented, this should never happen!\n", __FILE__, __LINE__);
+#ifdef HAVE_MPI
+		if(mpi_is_initialized) {
+			mpi_send(msg);
+			msg_release_content(msg);
+			return;
+		}
+#endif
+		// If the ring is full, drain the incoming ones while waiting, so that
+		// two kernels sending to each other cannot deadlock
+		while(!shm_send(msg)) {
+			if(simulation_error() || shm_kernel_terminated(GidToKernel(msg->receiver))) {
+				break;
+			}
+			messages_checking();
+		}
+
+		// The payload has been copied into the ring
+		msg_release_content(msg);
 	}
 }
 
@@ -258,63 +331,24 @@ void Send(msg_t *msg) {
 
 
 
-#if 0
 /**
-*
+* This function places the messages sent by remote kernel instances into the bottom
+* halves of the receiving LPs.
 *
 * @author Francesco Quaglia
-*/
-static bool pending_msg(void) {
-
-    int flag = 0;
-
-    (void)comm_probe(MPI_ANY_SOURCE, MSG_EVENT, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
-    return (bool)flag;
-
-}
-
-
-/**
 *
-*
-* @author Francesco Quaglia
+* @return 1 if at least one message has been received, 0 otherwise
 */
 int messages_checking(void) {
-	msg_t msg;
-	int at_least_one_message = 0;
-
-
-	// Are we in GVT computation phase?
-	// TODO a cosa serve questa parte qui sotto?!
-//	if (ComputingGvt() == false)
-//		send_forced_ack();
+	int received = shm_receive();
 
-
-	// Check whether we have received any ack message
-	receive_ack();
-
-	// If we have pending messages, we process all of them in order to update the queues
- 	while(pending_msg()){
-
-		at_least_one_message = 1;
-
-		// Receive the message
-	    	(void)comm_recv((char*)&msg, sizeof(msg_t), MPI_CHAR, MPI_ANY_SOURCE, MSG_EVENT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-		// For GVT Operations
-		gvt_messages_rcvd[GidToKernel(msg.sender)] += 1;
-
-
-		// Update the queues
-//		DataUpdating(&msg);
-
-	}
+#ifdef HAVE_MPI
+	received += mpi_receive();
+#endif
 
 	// Did we receive at least one message?
-	return at_least_one_message;
-
+	return received > 0;
 }
-#endif
 
 
 
@@ -329,10 +363,15 @@ void insert_outgoing_msg(msg_t *msg) {
 
 	// If the model is generating many events at the same time, reallocate the outgoing buffer
 	if(LPS[current_lp]->outgoing_buffer.size == LPS[current_lp]->outgoing_buffer.max_size){
-		LPS[current_lp]->outgoing_buffer.max_size *= 2;
+		LPS[current_lp]->outgoing_buffer.max_size = (LPS[current_lp]->outgoing_buffer.max_size == 0 ? INIT_OUTGOING_MSG : LPS[current_lp]->outgoing_buffer.max_size * 2);
 		LPS[current_lp]->outgoing_buffer.outgoing_msgs = rsrealloc(LPS[current_lp]->outgoing_buffer.outgoing_msgs, sizeof(msg_t) * LPS[current_lp]->outgoing_buffer.max_size);
 	}
 
+	// Remember the minimum in transit before this batch, in case the batch is discarded
+	if(LPS[current_lp]->outgoing_buffer.size == 0) {
+		LPS[current_lp]->outgoing_buffer.min_in_transit_before = LPS[current_lp]->outgoing_buffer.min_in_transit[LPS[current_lp]->worker_thread];
+	}
+
 	// Message structure was declared on stack in ScheduleNewEvent: make a copy!
 	LPS[current_lp]->outgoing_buffer.outgoing_msgs[LPS[current_lp]->outgoing_buffer.size++] = *msg;
 
@@ -360,8 +399,32 @@ void send_outgoing_msgs(unsigned int lid) {
 		msg_hdr.timestamp = msg->timestamp;
 		msg_hdr.send_time = msg->send_time;
 		msg_hdr.mark = msg->mark;
-		(void)list_insert(LPS[msg->sender]->queue_out, send_time, &msg_hdr);
+		(void)list_insert(LPS[lid]->queue_out, send_time, &msg_hdr);
+	}
+
+	LPS[lid]->outgoing_buffer.size = 0;
+}
+
+
+
+/**
+* This function drops the messages buffered by a LP without sending them, e.g.
+* because the event which generated them has been aborted. Their payloads are
+* released, and their contribution to the minimum in transit is undone.
+*
+* @param lid The local id of the LP
+*/
+void discard_outgoing_msgs(unsigned int lid) {
+	register unsigned int i;
+
+	if(LPS[lid]->outgoing_buffer.size == 0) {
+		return;
+	}
+
+	for(i = 0; i < LPS[lid]->outgoing_buffer.size; i++) {
+		msg_release_content(&LPS[lid]->outgoing_buffer.outgoing_msgs[i]);
 	}
 
+	LPS[lid]->outgoing_buffer.min_in_transit[LPS[lid]->worker_thread] = LPS[lid]->outgoing_buffer.min_in_transit_before;
 	LPS[lid]->outgoing_buffer.size = 0;
 }
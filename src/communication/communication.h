@@ -31,19 +31,10 @@
 #ifndef _COMMUNICATION_H_
 #define _COMMUNICATION_H_
 
+#include <limits.h>
 #include <core/core.h>
 
 
-/// Ack window size
-#define WND_BUFFER_LENGTH	10000
-/// Ack window size
-#define WINDOW_DIMENSION	50
-
-
-
-/// Number of slots used by MPI for buffering messages
-#define SLOTS	100000
-
 
 /// Simulation Platform Control Messages
 enum _control_msgs {
@@ -78,30 +69,26 @@ enum _control_msgs {
 #define INIT_OUTGOING_MSG	10
 
 
+/// Size (in bytes) of each shared memory ring buffer connecting two kernel instances
+#define SHM_RING_SIZE		(1024 * 1024)
+
+/// Size (in bytes) of the shared memory heap hosting the state shared by all kernel instances
+#define SHM_HEAP_SIZE		(16 * 1024 * 1024)
+
+/// Length marker of a record telling that the ring restarts from its beginning
+#define SHM_RING_WRAP		UINT_MAX
+
+
 /// This structure is used by the communication subsystem to handle outgoing messages
 typedef struct _outgoing_t {
 	msg_t *outgoing_msgs;
 	unsigned int size;
 	unsigned int max_size;
 	simtime_t *min_in_transit;
+	simtime_t min_in_transit_before;
 } outgoing_t;
 
 
-/** @todo Document this structure */
-typedef struct _window {
-	int msg_number;
-	simtime_t min_timestamp;
-} window;
-
-
-/** @todo Document this structure */
-typedef struct _wnd_buffer {
-	unsigned int first_wnd;
-	unsigned int next_wnd;
-	window wnd_buffer[WND_BUFFER_LENGTH];
-} wnd_buffer;
-
-
 
 extern void ParallelScheduleNewEvent(unsigned int, simtime_t, unsigned int, void *, unsigned int);
 
@@ -115,15 +102,45 @@ extern simtime_t receive_time_barrier(simtime_t max);
 extern int messages_checking(void);
 extern void insert_outgoing_msg(msg_t *msg);
 extern void send_outgoing_msgs(unsigned int);
+extern void discard_outgoing_msgs(unsigned int);
 extern void send_antimessages(unsigned int, simtime_t);
+extern void msg_set_content(msg_t *msg, void *content, unsigned int size);
+extern void msg_release_content(msg_t *msg);
+extern void kernels_barrier(void);
+
+/* In shm.c */
+extern void shm_init(void);
+extern int shm_fini(int code);
+extern void *shm_alloc(size_t size);
+extern void shm_free(void *ptr);
+extern void shm_barrier(void);
+extern void shm_set_error(void);
+extern bool shm_error(void);
+extern bool shm_send(msg_t *msg);
+extern int shm_receive(void);
+extern bool shm_kernel_terminated(unsigned int k);
+
+/* In mpi.c */
+#ifdef HAVE_MPI
+extern void mpi_init(int *argc, char ***argv);
+extern int mpi_fini(int code);
+extern void mpi_barrier(void);
+extern void mpi_send(msg_t *msg);
+extern int mpi_receive(void);
+extern void mpi_reduce_sent(unsigned long long *sent, unsigned long long *total);
+extern void mpi_reduce_min(simtime_t *values, simtime_t *result, unsigned int count);
+extern bool mpi_reduction_completed(void);
+#endif
 
 /* In window.c */
 extern void windows_init(void);
-extern void register_msg(msg_t *msg);
-extern void receive_ack(void);
-extern void send_forced_ack(void);
+extern void windows_fini(void);
+extern unsigned int register_msg(msg_t *msg);
+extern void register_incoming_msg(unsigned int epoch);
+extern void start_epoch(unsigned int round);
 extern simtime_t local_min_timestamp(void);
-extern void start_ack_timer(void);
+extern void sent_in_epoch(unsigned int epoch, unsigned long long *sent);
+extern unsigned long long received_in_epoch(unsigned int epoch);
 
 
 
@@ -0,0 +1,396 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+* @file mpi.c
+* @brief This module implements the transport used when kernel instances are
+*        started as the ranks of an MPI job, possibly on different machines.
+*        Events and antimessages are delivered with non-blocking point-to-point
+*        operations, and the GVT reduction relies on non-blocking collectives.
+*        Any worker thread can issue MPI calls: if the MPI library does not support
+*        concurrent calls, they are serialized.
+*/
+
+#ifdef HAVE_MPI
+
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include <core/core.h>
+#include <arch/atomic.h>
+#include <arch/thread.h>
+#include <queues/queues.h>
+#include <communication/communication.h>
+#include <mm/malloc.h>
+
+
+/// A message on the wire: the epoch of the sender and the message, followed by its out-of-line payload (if any)
+struct mpi_packet {
+	unsigned int	epoch;
+	msg_t		msg;
+};
+
+/// The sends of a worker thread which are still in progress
+struct pending_sends {
+	MPI_Request		*requests;
+	struct mpi_packet	**packets;	/// To be released upon completion
+	int			*indices;	/// Scratch array for MPI_Testsome
+	int			count;
+	int			max;
+};
+
+
+/// Serializes the MPI calls issued by different worker threads, if the MPI library cannot handle concurrent ones
+static spinlock_t mpi_lock;
+
+/// Can the MPI library handle concurrent calls from different threads?
+static bool mpi_support_multithread;
+
+/// Sends in progress, one entry per worker thread. Each thread completes its own ones
+static struct pending_sends *pending;
+
+/// Per-thread buffer for incoming packets
+static __thread struct mpi_packet *receive_buffer = NULL;
+
+/// Size of the per-thread buffer for incoming packets
+static __thread int receive_buffer_size = 0;
+
+/// The collective operation of the GVT reduction in progress (at most one at a time)
+static MPI_Request reduction_request = MPI_REQUEST_NULL;
+
+
+#define lock_mpi()	do { if(!mpi_support_multithread) spin_lock(&mpi_lock); } while(0)
+#define unlock_mpi()	do { if(!mpi_support_multithread) spin_unlock(&mpi_lock); } while(0)
+
+// Receiving is opportunistic: if another thread is using MPI, we don't wait for it
+#define trylock_mpi()	(mpi_support_multithread || spin_trylock(&mpi_lock))
+
+
+
+/**
+* This function joins the MPI job. If more than one rank is running, each rank becomes a
+* kernel instance: kid and n_ker are set accordingly, and mpi_is_initialized is set. If this
+* is the only rank, MPI is finalized right away and the simulation runs as usual.
+*
+* @param argc Pointer to the number of command line arguments
+* @param argv Pointer to the command line arguments
+*/
+void mpi_init(int *argc, char ***argv) {
+	int provided, size, rank;
+
+	if(MPI_Init_thread(argc, argv, MPI_THREAD_MULTIPLE, &provided) != MPI_SUCCESS) {
+		rootsim_error(true, "Unable to initialize MPI\n");
+		return;
+	}
+
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+	if(size == 1) {
+		MPI_Finalize();
+		return;
+	}
+
+	if(provided < MPI_THREAD_SERIALIZED) {
+		rootsim_error(true, "The MPI library does not allow calls from multiple threads\n");
+		return;
+	}
+
+	if(size > N_KER_MAX) {
+		rootsim_error(true, "Running on %d MPI ranks, but at most %d kernel instances are supported\n", size, N_KER_MAX);
+		return;
+	}
+
+	if(n_ker > 1) {
+		rootsim_error(true, "--kernels cannot be used when running on more than one MPI rank\n");
+		return;
+	}
+
+	n_ker = size;
+	kid = rank;
+
+	if(n_prc_tot < n_cores * n_ker) {
+		rootsim_error(true, "Requested a simulation run with %u LPs and %u worker threads on %u kernels: the mapping is not possible. Aborting...\n", n_prc_tot, n_cores, n_ker);
+		return;
+	}
+
+	pending = rsalloc(sizeof(struct pending_sends) * n_cores);
+	bzero(pending, sizeof(struct pending_sends) * n_cores);
+
+	mpi_support_multithread = (provided == MPI_THREAD_MULTIPLE);
+	spinlock_init(&mpi_lock);
+	mpi_is_initialized = true;
+}
+
+
+
+/**
+* Release the packets of the sends which have completed. It must be called holding mpi_lock.
+*
+* @param sends The sends in progress of a thread
+*/
+static void complete_sends(struct pending_sends *sends) {
+	int i, j, completed;
+
+	if(sends->count == 0)
+		return;
+
+	MPI_Testsome(sends->count, sends->requests, &completed, sends->indices, MPI_STATUSES_IGNORE);
+	if(completed == MPI_UNDEFINED || completed == 0)
+		return;
+
+	for(i = 0; i < completed; i++) {
+		rsfree(sends->packets[sends->indices[i]]);
+	}
+
+	// Completed requests have been set to MPI_REQUEST_NULL: compact the arrays
+	for(i = 0, j = 0; i < sends->count; i++) {
+		if(sends->requests[i] != MPI_REQUEST_NULL) {
+			sends->requests[j] = sends->requests[i];
+			sends->packets[j] = sends->packets[i];
+			j++;
+		}
+	}
+	sends->count = j;
+}
+
+
+
+/**
+* Receive all the packets which are available. It must be called holding mpi_lock.
+* Matched probes are used, so that threads receiving concurrently cannot steal
+* each other's messages.
+*
+* @param deliver If false, the messages are just accounted and discarded
+* @return The number of messages which have been received
+*/
+static int receive_packets(bool deliver) {
+	int flag, length, received = 0;
+	MPI_Message message;
+	MPI_Status status;
+	msg_t msg;
+
+	while(true) {
+		MPI_Improbe(MPI_ANY_SOURCE, MSG_EVENT, MPI_COMM_WORLD, &flag, &message, &status);
+		if(!flag)
+			break;
+
+		MPI_Get_count(&status, MPI_BYTE, &length);
+		if(length > receive_buffer_size) {
+			receive_buffer = rsrealloc(receive_buffer, length);
+			receive_buffer_size = length;
+		}
+
+		MPI_Mrecv(receive_buffer, length, MPI_BYTE, &message, MPI_STATUS_IGNORE);
+
+		if(deliver) {
+			// The payload travels out of line only if the packet is longer than the message
+			memcpy(&msg, &receive_buffer->msg, sizeof(msg_t));
+			if((size_t)length > sizeof(struct mpi_packet)) {
+				msg.extra_content = rsalloc(msg.size);
+				memcpy(msg.extra_content, receive_buffer + 1, msg.size);
+			}
+
+			insert_bottom_half(&msg);
+		}
+
+		register_incoming_msg(receive_buffer->epoch);
+		received++;
+	}
+
+	return received;
+}
+
+
+
+/**
+* This function finalizes the MPI transport. Messages sent by other kernels might still be
+* travelling towards this one: they are drained (and discarded), so that no send is left
+* pending when MPI is finalized. If this kernel is failing, the whole job is aborted.
+*
+* @param code The exit code of this kernel instance
+* @return The exit code
+*/
+int mpi_fini(int code) {
+	unsigned long long sent[N_KER_MAX];
+	unsigned long long local[2], total[2];
+	unsigned int i, k;
+
+	if(!mpi_is_initialized)
+		return code;
+
+	if(code != EXIT_SUCCESS) {
+		MPI_Abort(MPI_COMM_WORLD, code);
+	}
+
+	// Worker threads are gone: no other thread can issue MPI calls now
+	do {
+		receive_packets(false);
+
+		local[0] = 0;
+		sent_in_epoch(0, sent);
+		for(k = 0; k < n_ker; k++)
+			local[0] += sent[k];
+		sent_in_epoch(1, sent);
+		for(k = 0; k < n_ker; k++)
+			local[0] += sent[k];
+		local[1] = received_in_epoch(0) + received_in_epoch(1);
+
+		MPI_Allreduce(local, total, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+	} while(total[0] != total[1]);
+
+	for(i = 0; i < n_cores; i++) {
+		MPI_Waitall(pending[i].count, pending[i].requests, MPI_STATUSES_IGNORE);
+		while(pending[i].count > 0) {
+			rsfree(pending[i].packets[--pending[i].count]);
+		}
+		rsfree(pending[i].requests);
+		rsfree(pending[i].packets);
+		rsfree(pending[i].indices);
+	}
+	rsfree(pending);
+	rsfree(receive_buffer);
+
+	MPI_Finalize();
+	mpi_is_initialized = false;
+
+	return code;
+}
+
+
+
+/**
+* A barrier across kernel instances. It must be called by only one thread per kernel.
+*/
+void mpi_barrier(void) {
+	lock_mpi();
+	MPI_Barrier(MPI_COMM_WORLD);
+	unlock_mpi();
+}
+
+
+
+/**
+* This function sends a message to the kernel hosting its receiver. The send is
+* non-blocking, and the payload is copied, so that the caller keeps its ownership.
+*
+* @param msg The message to send
+*/
+void mpi_send(msg_t *msg) {
+	struct pending_sends *sends = &pending[tid];
+	struct mpi_packet *packet;
+	unsigned int extra = (msg->extra_content != NULL ? msg->size : 0);
+	size_t length = sizeof(struct mpi_packet) + extra;
+
+	packet = rsalloc(length);
+	packet->epoch = register_msg(msg);
+	memcpy(&packet->msg, msg, sizeof(msg_t));
+	packet->msg.extra_content = NULL;
+	if(extra > 0) {
+		memcpy(packet + 1, msg->extra_content, extra);
+	}
+
+	if(sends->count == sends->max) {
+		sends->max = (sends->max == 0 ? INIT_OUTGOING_MSG : sends->max * 2);
+		sends->requests = rsrealloc(sends->requests, sizeof(MPI_Request) * sends->max);
+		sends->packets = rsrealloc(sends->packets, sizeof(struct mpi_packet *) * sends->max);
+		sends->indices = rsrealloc(sends->indices, sizeof(int) * sends->max);
+	}
+
+	lock_mpi();
+	MPI_Isend(packet, (int)length, MPI_BYTE, (int)GidToKernel(msg->receiver), MSG_EVENT, MPI_COMM_WORLD, &sends->requests[sends->count]);
+	sends->packets[sends->count++] = packet;
+	complete_sends(sends);
+	unlock_mpi();
+}
+
+
+
+/**
+* This function moves the messages sent by other kernel instances to the bottom halves
+* of the receiving LPs. If MPI calls are serialized and another thread is using MPI, it
+* returns immediately: the GVT reduction does not rely on this function to drain all the
+* incoming messages, as transient messages are accounted in window.c.
+*
+* @return The number of messages which have been received
+*/
+int mpi_receive(void) {
+	int received;
+
+	if(!mpi_is_initialized || !trylock_mpi())
+		return 0;
+
+	received = receive_packets(true);
+	complete_sends(&pending[tid]);
+
+	unlock_mpi();
+
+	return received;
+}
+
+
+
+/**
+* Start the reduction of the number of messages which each kernel has sent to any other
+* kernel. The reduction completes when mpi_reduction_completed() returns true.
+*
+* @param sent An array of n_ker entries, with the messages sent by this kernel to each kernel
+* @param total An array of n_ker entries, receiving the messages sent by all kernels to each kernel
+*/
+void mpi_reduce_sent(unsigned long long *sent, unsigned long long *total) {
+	lock_mpi();
+	MPI_Iallreduce(sent, total, (int)n_ker, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD, &reduction_request);
+	unlock_mpi();
+}
+
+
+
+/**
+* Start the reduction of the minimum of some values across kernels. The reduction
+* completes when mpi_reduction_completed() returns true.
+*
+* @param values The values of this kernel
+* @param result Receives the minimum of each value across all kernels
+* @param count The number of values
+*/
+void mpi_reduce_min(simtime_t *values, simtime_t *result, unsigned int count) {
+	lock_mpi();
+	MPI_Iallreduce(values, result, (int)count, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD, &reduction_request);
+	unlock_mpi();
+}
+
+
+
+/**
+* Check whether the last reduction started has completed
+*
+* @return true if the result of the reduction is available
+*/
+bool mpi_reduction_completed(void) {
+	int flag;
+
+	lock_mpi();
+	MPI_Test(&reduction_request, &flag, MPI_STATUS_IGNORE);
+	unlock_mpi();
+
+	return flag != 0;
+}
+
+#endif /* HAVE_MPI */
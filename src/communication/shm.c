@@ -0,0 +1,397 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+* @file shm.c
+* @brief This module implements the transport used when more than one simulation
+*        kernel instance runs on the same machine. Instances are separate processes,
+*        forked at startup, which share an anonymous shared memory segment. Messages
+*        are exchanged over one ring buffer for each (sender, receiver) pair of
+*        kernels, and a small heap in the segment hosts the state which must be
+*        shared by all kernels (e.g., the GVT reduction).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <core/core.h>
+#include <arch/atomic.h>
+#include <queues/queues.h>
+#include <communication/communication.h>
+#include <mm/malloc.h>
+
+
+/// A record in a ring: the message, followed by its out-of-line payload (if any)
+struct shm_record {
+	unsigned int	length;		/// Length of the whole record (SHM_RING_WRAP if the ring restarts from its beginning)
+	msg_t		msg;
+};
+
+/// A single-receiver-kernel ring buffer. Positions are free running byte counters
+struct shm_ring {
+	spinlock_t		producers;
+	spinlock_t		consumers;
+	volatile unsigned long	head;
+	volatile unsigned long	tail;
+	char			data[SHM_RING_SIZE];
+} __attribute__((aligned(64)));
+
+/// Control block at the beginning of the shared segment
+struct shm_control {
+	atomic_t		barrier_count;
+	volatile unsigned int	barrier_sense;
+	volatile unsigned int	error;
+	volatile unsigned int	terminated[N_KER_MAX];
+} __attribute__((aligned(64)));
+
+
+/// Beginning of the shared segment. NULL if this is the only kernel instance
+static char *segment = NULL;
+
+/// Size of the shared segment
+static size_t segment_size;
+
+/// Control block in the shared segment
+static struct shm_control *control;
+
+/// Heap for the state shared by all kernels
+static char *shared_heap;
+
+/// Allocation offset in the shared heap. All kernels allocate in the same order, so offsets match
+static size_t shared_heap_offset = 0;
+
+/// The n_ker * n_ker ring buffers. The one from kernel i to kernel j is at i * n_ker + j
+static struct shm_ring *rings;
+
+/// Pids of the forked kernel instances (only meaningful in the master kernel)
+static pid_t *kernel_pids;
+
+/// Local sense for the kernel barrier
+static unsigned int barrier_local_sense = 0;
+
+
+
+#define ring_of(from, to)	(&rings[(from) * n_ker + (to)])
+
+#define record_length(size)	((sizeof(struct shm_record) + (size) + 7) & ~((size_t)7))
+
+
+
+/**
+* This function creates the shared memory segment and forks the other kernel instances.
+* Upon return, kid is set in each process. It must be called before any thread is created.
+*/
+void shm_init(void) {
+	unsigned int k;
+	pid_t pid;
+
+	segment_size = sizeof(struct shm_control) + SHM_HEAP_SIZE + (size_t)n_ker * n_ker * sizeof(struct shm_ring);
+
+	// The mapping is inherited by the forked kernels. It is zero-filled: all the shared state starts zeroed
+	segment = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(segment == MAP_FAILED) {
+		segment = NULL;
+		rootsim_error(true, "Unable to map %zu bytes of shared memory\n", segment_size);
+		return;
+	}
+
+	control = (struct shm_control *)segment;
+	shared_heap = segment + sizeof(struct shm_control);
+	rings = (struct shm_ring *)(shared_heap + SHM_HEAP_SIZE);
+
+	// Do not let buffered output be duplicated into children
+	fflush(stdout);
+	fflush(stderr);
+
+	kernel_pids = rsalloc(sizeof(pid_t) * n_ker);
+	kid = 0;
+	for(k = 1; k < n_ker; k++) {
+		pid = fork();
+		if(pid == -1) {
+			rootsim_error(true, "Unable to fork simulation kernel %d\n", k);
+			return;
+		}
+		if(pid == 0) {
+			kid = k;
+			break;
+		}
+		kernel_pids[k] = pid;
+	}
+}
+
+
+
+/**
+* This function finalizes the shared memory transport. The master kernel waits for the
+* other instances to terminate.
+*
+* @param code The exit code of this kernel instance
+* @return The exit code of the whole simulation, if this is the master kernel, or code otherwise
+*/
+int shm_fini(int code) {
+	unsigned int k;
+	int status;
+
+	if(segment == NULL)
+		return code;
+
+	control->terminated[kid] = 1;
+
+	if(master_kernel()) {
+		for(k = 1; k < n_ker; k++) {
+			if(waitpid(kernel_pids[k], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+				code = EXIT_FAILURE;
+			}
+		}
+	}
+
+	rsfree(kernel_pids);
+	munmap(segment, segment_size);
+	segment = NULL;
+
+	return code;
+}
+
+
+
+/**
+* This function returns memory which is shared by all kernel instances, or private memory
+* if this is the only kernel. All kernels must perform the same allocations in the same
+* order during initialization. Shared memory is zeroed when the segment is created, so
+* it must be initialized only with values which are the same in every kernel.
+*
+* @param size The size of the memory to allocate
+* @return A pointer to the (zeroed) memory
+*/
+void *shm_alloc(size_t size) {
+	void *ptr;
+
+	if(segment == NULL) {
+		ptr = rsalloc(size);
+		bzero(ptr, size);
+		return ptr;
+	}
+
+	size = (size + 63) & ~((size_t)63);
+	if(shared_heap_offset + size > SHM_HEAP_SIZE) {
+		rootsim_error(true, "Shared memory heap exhausted: increase SHM_HEAP_SIZE\n");
+		return NULL;
+	}
+
+	ptr = shared_heap + shared_heap_offset;
+	shared_heap_offset += size;
+	return ptr;
+}
+
+
+
+/**
+* This function releases memory obtained from shm_alloc()
+*
+* @param ptr The memory to release
+*/
+void shm_free(void *ptr) {
+	if(segment == NULL) {
+		rsfree(ptr);
+	}
+}
+
+
+
+/**
+* A sense-reversing barrier across kernel instances. It must be called by only one
+* thread per kernel. If some kernel incurs a fatal error, waiting kernels exit.
+*/
+void shm_barrier(void) {
+
+	if(segment == NULL)
+		return;
+
+	barrier_local_sense = !barrier_local_sense;
+
+	atomic_inc(&control->barrier_count);
+	if((unsigned int)atomic_read(&control->barrier_count) == n_ker) {
+		atomic_set(&control->barrier_count, 0);
+		control->barrier_sense = barrier_local_sense;
+	} else {
+		while(control->barrier_sense != barrier_local_sense) {
+			if(control->error) {
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+}
+
+
+
+/**
+* Notify all kernel instances that a fatal error occurred
+*/
+void shm_set_error(void) {
+	if(segment != NULL) {
+		control->error = 1;
+	}
+}
+
+
+
+/**
+* Check whether some kernel instance incurred a fatal error
+*
+* @return true if a fatal error occurred somewhere
+*/
+bool shm_error(void) {
+	return segment != NULL && control->error;
+}
+
+
+
+/**
+* This function tries to place a message in the ring towards the kernel hosting its receiver.
+* The payload is copied along with the message, so that the caller keeps its ownership.
+*
+* @param msg The message to send
+* @return true if the message has been placed in the ring, false if the ring is full
+*/
+bool shm_send(msg_t *msg) {
+	struct shm_ring *ring = ring_of(kid, GidToKernel(msg->receiver));
+	struct shm_record *record;
+	size_t length, padding = 0;
+	unsigned long offset;
+	unsigned int extra = (msg->extra_content != NULL ? msg->size : 0);
+
+	length = record_length(extra);
+	if(length > SHM_RING_SIZE / 2) {
+		rootsim_error(true, "A message of %d bytes is too large for the shared memory transport\n", msg->size);
+		return true;
+	}
+
+	spin_lock(&ring->producers);
+
+	offset = ring->head % SHM_RING_SIZE;
+	if(SHM_RING_SIZE - offset < length) {
+		padding = SHM_RING_SIZE - offset;
+	}
+
+	if(SHM_RING_SIZE - (ring->head - ring->tail) < padding + length) {
+		spin_unlock(&ring->producers);
+		return false;
+	}
+
+	if(padding > 0) {
+		// There is always room for the length field, as records are 8-bytes aligned
+		((struct shm_record *)&ring->data[offset])->length = SHM_RING_WRAP;
+		offset = 0;
+	}
+
+	record = (struct shm_record *)&ring->data[offset];
+	record->length = length;
+	memcpy(&record->msg, msg, sizeof(msg_t));
+	record->msg.extra_content = NULL;
+	if(extra > 0) {
+		memcpy(record + 1, msg->extra_content, extra);
+	}
+
+	// The record must be visible before the new head
+	__sync_synchronize();
+	ring->head += padding + length;
+
+	spin_unlock(&ring->producers);
+
+	return true;
+}
+
+
+
+/**
+* This function moves all the messages sent by other kernel instances to the bottom halves
+* of the receiving LPs. If another thread is draining a ring, this function waits for it to
+* complete: upon return, every message which was in the rings when the function was called
+* has been placed into the bottom halves. This is what makes remote messages look like
+* local ones to the GVT reduction.
+*
+* @return The number of messages which have been received
+*/
+int shm_receive(void) {
+	unsigned int k;
+	int received = 0;
+	struct shm_ring *ring;
+	struct shm_record *record;
+	unsigned long offset;
+	msg_t msg;
+
+	if(segment == NULL)
+		return 0;
+
+	for(k = 0; k < n_ker; k++) {
+		if(k == kid)
+			continue;
+
+		ring = ring_of(k, kid);
+		if(ring->tail == ring->head)
+			continue;
+
+		spin_lock(&ring->consumers);
+
+		while(ring->tail != ring->head) {
+			offset = ring->tail % SHM_RING_SIZE;
+			record = (struct shm_record *)&ring->data[offset];
+
+			if(record->length == SHM_RING_WRAP) {
+				ring->tail += SHM_RING_SIZE - offset;
+				continue;
+			}
+
+			// The payload travels out of line only if the record is longer than the message
+			memcpy(&msg, &record->msg, sizeof(msg_t));
+			if(record->length > record_length(0)) {
+				msg.extra_content = rsalloc(msg.size);
+				memcpy(msg.extra_content, record + 1, msg.size);
+			}
+
+			insert_bottom_half(&msg);
+			received++;
+
+			// The record can be overwritten only after it has been copied
+			__sync_synchronize();
+			ring->tail += record->length;
+		}
+
+		spin_unlock(&ring->consumers);
+	}
+
+	return received;
+}
+
+
+
+/**
+* Check whether a kernel instance has already terminated its execution
+*
+* @param k The kernel id
+* @return true if the kernel is not running anymore
+*/
+bool shm_kernel_terminated(unsigned int k) {
+	return segment != NULL && control->terminated[k];
+}
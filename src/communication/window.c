@@ -19,45 +19,41 @@
 * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 *
 * @file window.c
-* @brief This module implements the acking windows used to notify other instances
-*        of the simulator that a set of messages has been received and correctly
-*        enqueued.
+* @brief This module keeps track of the messages exchanged with other instances
+*        of the simulator, so that the distributed GVT reduction can account for
+*        messages which are still in transit. Each worker thread colours the messages
+*        it sends with the epoch it is in, and switches epoch when it enters a new
+*        GVT round. Messages of the previous epoch are counted per destination kernel,
+*        and the receivers count what they get: when the two figures match, no message
+*        of the previous epoch is in transit anymore (Mattern's scheme).
 * @author Francesco Quaglia
 *
 */
 
 
 #include <stdlib.h>
-#include <float.h>
+#include <string.h>
 
 #include <core/core.h>
-#include <core/timer.h>
-#include <gvt/gvt.h>
-#include <queues/queues.h>
+#include <arch/thread.h>
 #include <communication/communication.h>
-#include <scheduler/process.h>
+#include <mm/malloc.h>
 
 
+/// Messages sent to remote kernels, indexed by [thread][epoch colour][destination kernel]
+static unsigned long long *sent_messages;
 
+/// Messages received from remote kernels, per epoch colour
+static volatile unsigned long long received_messages[2];
 
+/// Minimum timestamp of the messages sent by each thread since it entered its current epoch
+static simtime_t *epoch_min_timestamp;
 
-// This was used by the old GVT. This is no longer needed on a multicore system.
-// I'm leaving this here because we are currently rethinking the distributed GVT algorithm,
-// so this might be useful as a reference.
-#if 0
+/// The colour of the epoch the calling thread is in
+static __thread unsigned int my_epoch = 0;
 
 
-
-/// Circular buffer for acking messages
-static wnd_buffer buffer[N_KER_MAX];
-
-
-/// Total number of acked messages (per simulation kernel)
-static int acked_messages[N_KER_MAX];
-
-
-/// Timer for acking messages
-timer ack_timer;
+#define sent_slot(thread, epoch, k)	(((thread) * 2 + (epoch)) * n_ker + (k))
 
 
 
@@ -67,214 +63,120 @@ timer ack_timer;
 * @author Francesco Quaglia
 */
 void windows_init(void) {
-	register unsigned int i, k;
-
-	// Buffer initialization for windowed acking subsystem
-	for (k = 0; k < n_ker; k++) {
-		buffer[k].first_wnd = buffer[k].next_wnd = 0;
-		for (i = 0; i < WND_BUFFER_LENGTH; i++) {
-			buffer[k].wnd_buffer[i].msg_number= 0;
-			buffer[k].wnd_buffer[i].min_timestamp = -1.;
-		}
-	}
-}
+	unsigned int i;
 
+	sent_messages = rsalloc(sizeof(unsigned long long) * n_cores * 2 * n_ker);
+	bzero(sent_messages, sizeof(unsigned long long) * n_cores * 2 * n_ker);
 
+	epoch_min_timestamp = rsalloc(sizeof(simtime_t) * n_cores);
+	for(i = 0; i < n_cores; i++) {
+		epoch_min_timestamp[i] = INFTY;
+	}
 
+	received_messages[0] = received_messages[1] = 0;
+}
 
 
 
 /**
-* This function start the ack timer
-*
-* @author Roberto Vitali
-*
+* Finalization of the window subsystem
 */
-void start_ack_timer(void) {
-	timer_start(ack_timer);
+void windows_fini(void) {
+	rsfree(epoch_min_timestamp);
+	rsfree(sent_messages);
 }
 
 
 
-
 /**
-* This function registers a message in the buffer, until the corresponding ack is received
+* This function registers a message sent to a remote kernel by the calling thread
 *
 * @author Francesco Quaglia
-* @author Roberto Vitali
 *
+* @param msg The message being sent
+* @return The colour of the epoch the message belongs to, which must travel with it
 */
-void register_msg(msg_t *msg) {
-	register unsigned int k;
-
-	// Operate on the local buffer targeted at a particular destination kernel
-	k = GidToKernel(msg->receiver);
-
-	register unsigned int next = buffer[k].next_wnd;
-
-	if (buffer[k].wnd_buffer[next].msg_number == 0) { // Message box is empty
-		buffer[k].wnd_buffer[next].msg_number++;
-		buffer[k].wnd_buffer[next].min_timestamp = msg->timestamp;
-	} else if (buffer[k].wnd_buffer[next].msg_number < WINDOW_DIMENSION) { // // Message box is not empty
-		buffer[k].wnd_buffer[next].msg_number++;
-		// Does the new message have a timestamp less than the one registered in the box?
-		if (((buffer[k].wnd_buffer[next].min_timestamp - 1) < DBL_EPSILON) || msg->timestamp < buffer[k].wnd_buffer[next].min_timestamp)
-			buffer[k].wnd_buffer[next].min_timestamp = msg->timestamp;
-	}
-
-	// If the message box dimesion has been reached
-	if (buffer[k].wnd_buffer[next].msg_number == WINDOW_DIMENSION) {
+unsigned int register_msg(msg_t *msg) {
+	sent_messages[sent_slot(tid, my_epoch, GidToKernel(msg->receiver))]++;
 
-		buffer[k].next_wnd++;
-		buffer[k].next_wnd %= WND_BUFFER_LENGTH;
-
-		if (buffer[k].next_wnd == buffer[k].first_wnd) {
-			rootsim_error(true, "Error, ack window overflow\n");
-		}
+	if(msg->timestamp < epoch_min_timestamp[tid]) {
+		epoch_min_timestamp[tid] = msg->timestamp;
 	}
 
+	return my_epoch;
 }
 
 
 
-
-#if 0
 /**
-* This function update the ack window upon new acks reception
+* This function registers a message received from a remote kernel, once it has been
+* placed into the bottom half of the receiving LP
 *
-* @author Francesco Quaglia
-* @author Roberto Vitali
+* @param epoch The colour the sender assigned to the message
 */
-void receive_ack(void) {
-	int i, flag = 0;
-	int ack_number, from_kernel;
-	MPI_Status status;
-
-	comm_probe(MPI_ANY_SOURCE, MSG_GVT_ACK, MPI_COMM_WORLD, &flag, &status);
-
-	// If we can receive an ack
-	if (flag != 0) {
-		from_kernel = status.MPI_SOURCE;
-		// do receive it!
-		comm_recv(&ack_number,sizeof(ack_number),MPI_CHAR,from_kernel,MSG_GVT_ACK,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
-
-		gvt_messages_sent[from_kernel] -= ack_number;
-		if(gvt_messages_sent[from_kernel] < 0) {
-
-			comm_abort(MPI_COMM_WORLD, 0);
-			rootsim_error(true, "Negative messages sent. gvt_messages_sent[%d] = %d\n\n", from_kernel, gvt_messages_sent[from_kernel]);
-
-		}
-		acked_messages[from_kernel] += ack_number;
-
-		int next = buffer[from_kernel].next_wnd;
-		int first = buffer[from_kernel].first_wnd;
-
-		// This variable tells what's the last cell to be cancelled
-		int to_delete = acked_messages[from_kernel] / WINDOW_DIMENSION;
-
-		if ((first + to_delete) % WND_BUFFER_LENGTH == next &&
-		    acked_messages[from_kernel] % WINDOW_DIMENSION > buffer[from_kernel].wnd_buffer[next].msg_number) {
-			rootsim_error(true, "Received more ack than the number of sent messages\n");
-		}
+void register_incoming_msg(unsigned int epoch) {
+	__sync_fetch_and_add(&received_messages[epoch], 1);
+}
 
-		for (i = first; i < first + to_delete; i++) {
-			buffer[from_kernel].wnd_buffer[i % WND_BUFFER_LENGTH].msg_number = 0;
-			buffer[from_kernel].wnd_buffer[i % WND_BUFFER_LENGTH].min_timestamp = -1;
-		}
 
-		buffer[from_kernel].first_wnd = i % WND_BUFFER_LENGTH;
 
-		if(acked_messages[from_kernel] > 0)
-			acked_messages[from_kernel] = acked_messages[from_kernel] % WINDOW_DIMENSION;
-	}
+/**
+* Move the calling thread to the epoch of a new GVT round. Messages sent from now
+* on belong to the new epoch, and are no longer counted as transient by the round.
+*
+* @param round The GVT round the thread is entering
+*/
+void start_epoch(unsigned int round) {
+	my_epoch = round % 2;
+	epoch_min_timestamp[tid] = INFTY;
 }
 
 
 
-
 /**
-* This function sends ack to the kernels from which messages are received
+* This function retrieves the minimum timestamp of the messages sent by the calling
+* thread since it entered its current epoch. These messages might not be received
+* when the GVT round completes, so they must be accounted by the sender.
 *
-* @author Francesco Quaglia
+* @author Alessandro Pellegrini
+*
+* @return The minimum timestamp, or INFTY if no message has been sent
 */
-void send_forced_ack(void) {
-	register unsigned int i;
-
-	int delta_ack_timer = timer_value(ack_timer);
-
-	if (abs(delta_ack_timer) > (time_t) (GVT_ACK_TIME_PERIOD - 1)) {
-		timer_restart(ack_timer);
-		for (i = 0; i < n_ker; i++) {
-			if (i != kid && gvt_messages_rcvd[i]!=0) {
-				// Send the total number of messages which were received from kernel i.
-				// The i-th kernel will receive this number in receive_ack(), storing it
-				// into the ack_number variable
-				comm_basic_send( (char*)&gvt_messages_rcvd[i] , sizeof(int), MPI_CHAR, i, MSG_GVT_ACK, MPI_COMM_WORLD);
-				gvt_messages_rcvd[i] = 0;
-			}
-		}
-	}
+simtime_t local_min_timestamp(void) {
+	return epoch_min_timestamp[tid];
 }
-#endif
-
-
 
 
 
 /**
-* This function retrieve the min timestamp in the kernel considering both the event in the LP's queues and the messages sent by the kernel but not already acked
+* Count the messages of an epoch sent by this kernel to each remote kernel, since the
+* beginning of the simulation. The figures are final only once all the local threads
+* have left the epoch.
 *
-* @author Francesco Quaglia
 * @author Alessandro Pellegrini
+*
+* @param epoch The colour of the epoch
+* @param sent An array of n_ker entries, receiving the number of messages sent to each kernel
 */
-simtime_t local_min_timestamp(void) {
-	simtime_t min = INFTY, tmp;
-	register unsigned int i, k;
-
-	simtime_t min2;
-
-	// Computation of the min timestamp in the bottom half queue for the locally hosted LPs
-/*	for (i = 0; i < n_prc; i++) {
-		spin_lock(&LPS[i]->lock);
-		tmp = LPS[i]->min_bh_ts;
-		spin_unlock(&LPS[i]->lock);
-		if (tmp < min) {
-			min = tmp;
-		}
-		//~ printf("--%d: bh = %f , min = %f\n", i, tmp, min);
-    	}
-*/
-	// Computation of non-acked messages minimum timestamp
+void sent_in_epoch(unsigned int epoch, unsigned long long *sent) {
+	unsigned int i, k;
+
 	for(k = 0; k < n_ker; k++) {
-		for(i = buffer[k].first_wnd; i <= buffer[k].next_wnd; i++) {
-			tmp = buffer[k].wnd_buffer[i].min_timestamp;
-			if(D_DIFFER(tmp, -1.0) && tmp < min) {
-				min = tmp;
-			}
-			//~ printf("%d: non-acked = %f, min = %f\n", i, tmp, min);
+		sent[k] = 0;
+		for(i = 0; i < n_cores; i++) {
+			sent[k] += sent_messages[sent_slot(i, epoch, k)];
 		}
 	}
+}
 
-	min2 = min;
 
-	// Comparison between the obtained minimum timestamp and the timestamp of the min bound of all the woker threads
-/*	for (i = 0; i < n_cores; i++) {
-		tmp = min_bound_per_thread[i];
-		if (tmp < min) {
-			min = tmp;
-		}
-	}
-*/	for (i = 0; i < n_prc; i++) {
-		tmp = last_event_timestamp(i);
-		if (tmp < min2) {
-			min2 = tmp;
-		}
-		//~ printf("%d: lvt = %f, min = %f\n", i, tmp, min);
-	}
 
-	return min2;
+/**
+* Count the messages of an epoch received by this kernel since the beginning of the simulation
+*
+* @param epoch The colour of the epoch
+* @return The number of messages received
+*/
+unsigned long long received_in_epoch(unsigned int epoch) {
+	return received_messages[epoch];
 }
-
-#endif /* if 0 */
-
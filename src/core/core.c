@@ -38,6 +38,8 @@
 #include <mm/malloc.h>
 #include <gvt/gvt.h>
 #include <mm/dymelor.h>
+#include <mm/numa.h>
+#include <communication/communication.h>
 
 
 /// Barrier for all worker threads
@@ -139,12 +141,13 @@ void base_init(void) {
 	to_lid = (unsigned int *)rsalloc(sizeof(unsigned int) * n_prc_tot);
 	to_gid = (unsigned int *)rsalloc(sizeof(unsigned int) * n_prc_tot);
 
-	for(i = 0; i < N_KER_MAX; i++)
+	for(i = 0; i < n_ker; i++)
 		kernel_lid_to_gid[i] = (unsigned int *)rsalloc(sizeof(unsigned int) * n_prc_tot);
 
 	for (i = 0; i < n_prc_tot; i++) {
 
-		if (rootsim_config.snapshot == FULL_SNAPSHOT) {
+		// No instrumented version of the model is generated: incremental logs rely on DyMeLoR's dirty tracking
+		if (rootsim_config.snapshot == FULL_SNAPSHOT || rootsim_config.snapshot == INC_SNAPSHOT) {
 			OnGVT[i] = &OnGVT_light;
 			ProcessEvent[i] = &ProcessEvent_light;
 		}
@@ -187,7 +190,7 @@ void base_fini(void){
 	unsigned int i;
 	rsfree(kernel);
 
-	for(i = 0; i < N_KER_MAX; i++) {
+	for(i = 0; i < n_ker; i++) {
 		rsfree(kernel_lid_to_gid[i]);
 	}
 	rsfree(to_gid);
@@ -257,33 +260,32 @@ void simulation_shutdown(int code) {
 
 	exit_silently_from_kernel = true;
 
-	if(mpi_is_initialized) {
-		comm_finalize();
-
-		// TODO: qui è necessario notificare agli altri kernel che c'è stato un errore ed è necessario fare lo shutdown
-		if(master_kernel()) {
-		}
-	}
-
 	statistics_stop(code);
 
 	if(!rootsim_config.serial) {
 
 		thread_barrier(&all_thread_barrier);
 
-		// All kernels must exit at the same time
-		if(n_ker > 1) {
-//			comm_barrier(MPI_COMM_WORLD);
+		if(!master_thread()) {
+			// Only the master thread can exit the process, after finalization
+			pthread_exit(NULL);
 		}
 
-		if(master_thread()) {
-			statistics_fini();
-			dymelor_fini();
-			scheduler_fini();
-			gvt_fini();
-			communication_fini();
-			base_fini();
-		}
+#ifdef HAVE_MPI
+		// Drain the messages still in transit across ranks, or abort the whole job upon failure
+		code = mpi_fini(code);
+#endif
+
+		statistics_fini();
+		dymelor_fini();
+		scheduler_fini();
+		gvt_fini();
+		communication_fini();
+		numa_fini();
+		base_fini();
+
+		// The master kernel waits for the other ones to terminate, and reports their failures
+		code = shm_fini(code);
 	}
 
 	exit(code);
@@ -292,7 +294,7 @@ void simulation_shutdown(int code) {
 
 
 inline bool simulation_error(void) {
-	return sim_error;
+	return sim_error || shm_error();
 }
 
 
@@ -322,6 +324,9 @@ void rootsim_error(bool fatal, const char *msg, ...) {
 	fflush(stderr);
 
 	if(fatal) {
+		// Notify other kernel instances as well
+		shm_set_error();
+
 		if(rootsim_config.serial) {
 			abort();
 		} else {
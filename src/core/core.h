@@ -52,6 +52,7 @@
 // XXX: This should be moved to state or queues
 #define INVALID_SNAPSHOT	2000
 #define FULL_SNAPSHOT		2001
+#define INC_SNAPSHOT		2002
 
 /// This defines an idle process (i.e., the fake process to be executed when no events are available)
 #define IDLE_PROCESS	UINT_MAX
@@ -65,13 +66,8 @@
 /// Maximum number of kernels the distributed simulator can handle
 #define N_KER_MAX	128
 
-/// Maximum number of LPs the simulator will handle
-#define MAX_LPs		8192		// This is 2^20
-
-/// Maximum event size (in bytes)
-#define MAX_EVENT_SIZE	1120
-//#define MAX_EVENT_SIZE	(150 * sizeof(int))
-//#define MAX_EVENT_SIZE	1500
+/// Payloads up to this size (in bytes) are stored inline into the message, larger ones out of line
+#define INLINE_EVENT_SIZE	32
 
 // XXX: this should be moved somewhere else...
 #define VERBOSE_INFO	1700
@@ -149,10 +145,14 @@ typedef struct _msg_t {
 	unsigned long long	rendezvous_mark;	/// Unique identifier of the message, used for rendez-vous events
 //	struct _state_t 	*is_first_event_of;
 	// Application informations
-	char event_content[MAX_EVENT_SIZE];
 	int size;
+	char *extra_content;	/// Out-of-line payload, used only when the payload does not fit inline
+	char inline_content[INLINE_EVENT_SIZE];
 } msg_t;
 
+/// Pointer to the payload of a message, wherever it is stored
+#define msg_content(msg) ((msg)->extra_content != NULL ? (msg)->extra_content : (msg)->inline_content)
+
 
 /// Message envelope definition. This is used to handle the output queue and stores information needed to generate antimessages
 typedef struct _msg_hdr_t {
@@ -172,6 +172,13 @@ typedef struct _simulation_configuration {
 	int backtrace;			/// Debug mode flag
 	int scheduler;			/// Which scheduler to be used
 	int gvt_time_period;		/// Wall-Clock time to wait before executiong GVT operations
+	bool adaptive_gvt;		/// Tune the GVT period at runtime, starting from gvt_time_period
+	int gvt_mem_low;		/// Log memory (KB per thread and GVT interval) below which the GVT period can be lengthened
+	int gvt_mem_high;		/// Log memory (KB per thread and GVT interval) above which the GVT period is shortened
+	simtime_t time_window;		/// Events beyond GVT plus this value are not executed (0 disables optimism throttling)
+	bool adaptive_window;		/// Tune the optimism window at runtime, starting from time_window
+	int batch_events;		/// Maximum number of events executed in a row by the same LP
+	bool adaptive_batch;		/// Tune the number of events executed in a row at runtime, starting from batch_events
 	int gvt_snapshot_cycles;	/// GVT operations to be executed before rebuilding the state
 	int simulation_time;		/// Wall-clock-time based termination predicate
 	int lps_distribution;		/// Policy for the LP to Kernel mapping
@@ -185,6 +192,11 @@ typedef struct _simulation_configuration {
 	int verbose;			/// Kernel verbose
 	enum stat_levels stats;		/// Produce performance statistic file (default STATS_ALL)
 	bool serial;			// If the simulation must be run serially
+	int lp_rebalance_cycles;	/// GVT reductions between two LPs-to-threads rebalancing rounds (0 disables migration)
+	bool numa;			/// Pin worker threads and keep LPs' memory on the NUMA node of their thread
+	int input_queue;		/// Data structure keeping LPs' input queues
+	int gvt_algorithm;		/// Which GVT reduction to run
+	bool snapshot_lookup;		/// Give OnGVT the root state found in the time barrier log, instead of restoring the log
 	seed_type set_seed;		/// The master seed to be used in this run
 } simulation_configuration;
 
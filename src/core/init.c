@@ -45,6 +45,8 @@
 #include <mm/state.h>
 #include <mm/dymelor.h>
 #include <mm/malloc.h>
+#include <mm/numa.h>
+#include <queues/queues.h>
 #include <core/backtrace.h> // Place this after malloc.h!
 #include <statistics/statistics.h>
 #include <lib/numerical.h>
@@ -101,6 +103,13 @@ static int parse_cmd_line(int argc, char **argv) {
 	rootsim_config.output_dir = DEFAULT_OUTPUT_DIR;
 	rootsim_config.backtrace = false;
 	rootsim_config.gvt_time_period = 1000;
+	rootsim_config.adaptive_gvt = false;
+	rootsim_config.gvt_mem_low = 1024;
+	rootsim_config.gvt_mem_high = 16384;
+	rootsim_config.time_window = 0.0;
+	rootsim_config.adaptive_window = false;
+	rootsim_config.batch_events = 1;
+	rootsim_config.adaptive_batch = false;
 	rootsim_config.scheduler = SMALLEST_TIMESTAMP_FIRST;
 	rootsim_config.checkpointing = INVALID_STATE_SAVING;
 	rootsim_config.ckpt_period = 10;
@@ -115,6 +124,12 @@ static int parse_cmd_line(int argc, char **argv) {
 	rootsim_config.verbose = VERBOSE_INFO;
 	rootsim_config.stats = STATS_ALL;
 	rootsim_config.serial = false;
+	rootsim_config.lp_rebalance_cycles = 5;
+	rootsim_config.numa = false;
+	rootsim_config.input_queue = INPUT_QUEUE_LIST;
+	rootsim_config.gvt_algorithm = GVT_PHASES;
+	rootsim_config.snapshot_lookup = false;
+	n_ker = 1;
 
 
 	// Parse command-line options
@@ -176,9 +191,12 @@ static int parse_cmd_line(int argc, char **argv) {
 			case OPT_P:
 				if(rootsim_config.checkpointing == COPY_STATE_SAVING) {
 					rootsim_error(false, "Some options are conflicting: Copy State Saving is selected, but I'm requested to set a checkpointing interval. Skipping the -p option.\n");
+				} else if(rootsim_config.checkpointing == AUTONOMIC_STATE_SAVING) {
+					// The interval is only the initial one: it is then tuned at runtime
+					rootsim_config.ckpt_period = parseIntLimits(optarg, 1, MAX_CKPT_PERIOD);
 				} else {
 					rootsim_config.checkpointing = PERIODIC_STATE_SAVING;
-					rootsim_config.ckpt_period = parseIntLimits(optarg, 1, 40);
+					rootsim_config.ckpt_period = parseIntLimits(optarg, 1, MAX_CKPT_PERIOD);
 					// This is a micro optimization that makes the LogState function to avoid checking the checkpointing interval and keeping track of the logs taken
 					if(rootsim_config.ckpt_period == 1) {
 						rootsim_config.checkpointing = COPY_STATE_SAVING;
@@ -193,7 +211,7 @@ static int parse_cmd_line(int argc, char **argv) {
 				break;
 
 			case OPT_INC:
-				rootsim_error(false, "Incremental state saving is not supported in stable version yet...\n");
+				rootsim_config.snapshot = INC_SNAPSHOT;
 				break;
 
 			case OPT_A:
@@ -216,7 +234,7 @@ static int parse_cmd_line(int argc, char **argv) {
 				break;
 
 			case OPT_NPRC:
-				n_prc_tot = parseIntLimits(optarg, 1, MAX_LPs); // In this way, a change in MAX_LPs is reflected here
+				n_prc_tot = parseIntLimits(optarg, 1, INT_MAX);
 				break;
 
 			case OPT_BLOCKING_GVT:
@@ -286,6 +304,90 @@ static int parse_cmd_line(int argc, char **argv) {
 				rootsim_config.serial = true;
 				break;
 
+			case OPT_LP_REBALANCE:
+				rootsim_config.lp_rebalance_cycles = parseIntLimits(optarg, 0, INT_MAX);
+				break;
+
+			case OPT_CHECKPOINTING:
+				if(strcmp(optarg, "css") == 0) {
+					rootsim_config.checkpointing = COPY_STATE_SAVING;
+				} else if(strcmp(optarg, "pss") == 0) {
+					rootsim_config.checkpointing = PERIODIC_STATE_SAVING;
+				} else if(strcmp(optarg, "autonomic") == 0) {
+					rootsim_config.checkpointing = AUTONOMIC_STATE_SAVING;
+				} else {
+					rootsim_error(true, "Invalid argument for checkpointing");
+					return -1;
+				}
+				break;
+
+			case OPT_KERNELS:
+				n_ker = parseIntLimits(optarg, 1, N_KER_MAX);
+				break;
+
+			case OPT_ADAPTIVE_GVT:
+				rootsim_config.adaptive_gvt = true;
+				break;
+
+			case OPT_GVT_MEM_LOW:
+				rootsim_config.gvt_mem_low = parseIntLimits(optarg, 0, INT_MAX);
+				break;
+
+			case OPT_GVT_MEM_HIGH:
+				rootsim_config.gvt_mem_high = parseIntLimits(optarg, 1, INT_MAX);
+				break;
+
+			case OPT_TIME_WINDOW: {
+				char *endptr;
+				rootsim_config.time_window = strtod(optarg, &endptr);
+				if(*optarg == '\0' || *endptr != '\0' || rootsim_config.time_window < 0.0) {
+					rootsim_error(true, "Invalid option value: %s\n", optarg);
+				}
+				break;
+			}
+
+			case OPT_ADAPTIVE_WINDOW:
+				rootsim_config.adaptive_window = true;
+				break;
+
+			case OPT_BATCH_EVENTS:
+				rootsim_config.batch_events = parseIntLimits(optarg, 1, MAX_BATCH_EVENTS);
+				break;
+
+			case OPT_ADAPTIVE_BATCH:
+				rootsim_config.adaptive_batch = true;
+				break;
+
+			case OPT_NUMA:
+				rootsim_config.numa = true;
+				break;
+
+			case OPT_SNAPSHOT_LOOKUP:
+				rootsim_config.snapshot_lookup = true;
+				break;
+
+			case OPT_INPUT_QUEUE:
+				if(strcmp(optarg, "list") == 0) {
+					rootsim_config.input_queue = INPUT_QUEUE_LIST;
+				} else if(strcmp(optarg, "skiplist") == 0) {
+					rootsim_config.input_queue = INPUT_QUEUE_SKIPLIST;
+				} else {
+					rootsim_error(true, "Invalid argument for input_queue");
+					return -1;
+				}
+				break;
+
+			case OPT_GVT_ALGORITHM:
+				if(strcmp(optarg, "phases") == 0) {
+					rootsim_config.gvt_algorithm = GVT_PHASES;
+				} else if(strcmp(optarg, "single_pass") == 0) {
+					rootsim_config.gvt_algorithm = GVT_SINGLE_PASS;
+				} else {
+					rootsim_error(true, "Invalid argument for gvt_algorithm");
+					return -1;
+				}
+				break;
+
 			case -1:
 			case '?':
 			default:
@@ -296,8 +398,16 @@ static int parse_cmd_line(int argc, char **argv) {
 		#undef parseIntLimits
 	}
 
-	if(!rootsim_config.serial && n_prc_tot < n_cores) {
-		rootsim_error(true, "Requested a simulation run with %u LPs and %u worker threads: the mapping is not possible. Aborting...\n", n_prc_tot, n_cores);
+	if(!rootsim_config.serial && n_prc_tot < n_cores * n_ker) {
+		rootsim_error(true, "Requested a simulation run with %u LPs and %u worker threads on %u kernels: the mapping is not possible. Aborting...\n", n_prc_tot, n_cores, n_ker);
+	}
+
+	if(rootsim_config.adaptive_gvt && rootsim_config.gvt_mem_low >= rootsim_config.gvt_mem_high) {
+		rootsim_error(true, "The low memory watermark of the adaptive GVT (%d KB) must be below the high one (%d KB). Aborting...\n", rootsim_config.gvt_mem_low, rootsim_config.gvt_mem_high);
+	}
+
+	if(rootsim_config.adaptive_window && D_EQUAL_ZERO(rootsim_config.time_window)) {
+		rootsim_error(true, "An adaptive optimism window requires an initial one to be specified with --time_window. Aborting...\n");
 	}
 
 
@@ -325,8 +435,8 @@ static int parse_cmd_line(int argc, char **argv) {
 * @param argv array of parameters passed at command line
 */
 void SystemInit(int argc, char **argv) {
-	register unsigned int t;
 	int application_args;
+	int w;
 
 	// Parse the argument passed at command line, to initialize the internal configuration
 	application_args = parse_cmd_line(argc, argv);
@@ -334,6 +444,24 @@ void SystemInit(int argc, char **argv) {
 		return;
 	}
 
+#ifdef HAVE_MPI
+	// If we have been started by mpirun, each rank is a kernel instance
+	if(!rootsim_config.serial) {
+		mpi_init(&argc, &argv);
+	}
+#endif
+
+	// Fork the other kernel instances. From now on, each process runs its own kernel
+	if(!rootsim_config.serial && n_ker > 1 && !mpi_is_initialized) {
+		shm_init();
+	}
+
+	// Messages to other kernels are not delivered atomically, which the single-pass GVT relies on
+	if(rootsim_config.gvt_algorithm == GVT_SINGLE_PASS && n_ker > 1) {
+		rootsim_error(false, "The single-pass GVT reduction is supported by a single kernel only: falling back to phases\n");
+		rootsim_config.gvt_algorithm = GVT_PHASES;
+	}
+
 	// Initialize the backtrace handler if required
 	if(rootsim_config.backtrace && master_kernel() && master_thread()) {
 		INIT_BACKTRACE();
@@ -364,13 +492,22 @@ void SystemInit(int argc, char **argv) {
 			"Output Statistics Directory: %s\n"
 			"Scheduler: %d\n"
 			"GVT Time Period: %.2f seconds\n"
+			"Adaptive GVT Period: %d (log memory watermarks: %d-%d KB)\n"
+			"Optimism Window: %f (adaptive: %d)\n"
+			"Events Batch Size: %d (adaptive: %d)\n"
 			"Checkpointing Type: %d\n"
 			"Checkpointing Period: %d\n"
 			"Snapshot Reconstruction Type: %d\n"
 			"Halt Simulation After: %d\n"
+			"Kernel Instances: %u\n"
 			"LPs Distribution Mode across Kernels: %d\n"
 			"Check Termination Mode: %d\n"
 			"Blocking GVT: %d\n"
+			"LPs Rebalancing Period: %d GVT reductions\n"
+			"NUMA Placement: %d\n"
+			"Input Queue: %d\n"
+			"GVT Algorithm: %d\n"
+			"Snapshot Lookup in Logs: %d\n"
 			"Set Seed: %ld\n",
 			get_cores(),
 			n_cores,
@@ -378,82 +515,83 @@ void SystemInit(int argc, char **argv) {
 			rootsim_config.output_dir,
 			rootsim_config.scheduler,
 			rootsim_config.gvt_time_period / 1000.0,
+			rootsim_config.adaptive_gvt,
+			rootsim_config.gvt_mem_low,
+			rootsim_config.gvt_mem_high,
+			rootsim_config.time_window,
+			rootsim_config.adaptive_window,
+			rootsim_config.batch_events,
+			rootsim_config.adaptive_batch,
 			rootsim_config.checkpointing,
 			rootsim_config.ckpt_period,
 			rootsim_config.snapshot,
 			rootsim_config.simulation_time,
+			n_ker,
 			rootsim_config.lps_distribution,
 			rootsim_config.check_termination_mode,
 			rootsim_config.blocking_gvt,
+			rootsim_config.lp_rebalance_cycles,
+			rootsim_config.numa,
+			rootsim_config.input_queue,
+			rootsim_config.gvt_algorithm,
+			rootsim_config.snapshot_lookup,
 			rootsim_config.set_seed);
 	}
 
-	// Master Kernel initializes some variables, which are then passed to other kernel instances
-	if (master_kernel()) {
-		n_ker = 1;
-		distribute_lps_on_kernels();
-	} else { // Slave kernels
-		kernel = (unsigned int *)rsalloc(sizeof(unsigned int)*(n_prc_tot));
-	}
+	// The mapping is deterministic, so every kernel instance computes the same one
+	distribute_lps_on_kernels();
+
+	// We must pass the application-level args to the LPs in the INIT event.
+	// Skip all the NULL args (if any)
+	w = application_args;
+	while (argv[w] != NULL && (argv[w][0] == '\0' || argv[w][0] == ' '))
+		w++;
 
 	// Initialize ROOT-Sim subsystems.
 	// All init routines are executed serially (there is no notion of threads in there)
 	// and the order of invocation can matter!
 	base_init();
+	numa_init();
 	statistics_init();
-	scheduler_init();
+	scheduler_init(argc - w, &argv[w]);
 	communication_init();
 	dymelor_init();
 	gvt_init();
+	ccgs_init();
 	numerical_init();
 
-	printf("Initializing LPs... ");
-	fflush(stdout);
-
-	// Initialize the LP control block for each locally hosted LP
-	// and schedule the special INIT event
-	for (t = 0; t < n_prc; t++) {
-
-		// Create user level thread for the current LP and initialize LP control block
-		initialize_LP(t);
-
-		// We must pass the application-level args to the LP in the INIT event.
-		// Skip all the NULL args (if any)
-		int w = application_args;
-		while (argv[w] != NULL && (argv[w][0] == '\0' || argv[w][0] == ' '))
-			w++;
-
-		// Schedule an INIT event to the newly instantiated LP
-		msg_t init_event = {
-			sender: LidToGid(t),
-			receiver: LidToGid(t),
-			type: INIT,
-			timestamp: 0.0,
-			send_time: 0.0,
-			mark: generate_mark(LidToGid(t)),
-			size: argc - w,
-			message_kind: positive,
-		};
-
-		// Copy the relevant string pointers to the INIT event payload
-		if((argc - w) > 0) {
-			memcpy(init_event.event_content, &argv[w], (argc - w) * sizeof(char *));
-		}
+	// LPs are initialized by the worker threads hosting them: see rebind_LPs()
+	if(master_kernel()) {
+		printf("Initializing LPs... ");
+		fflush(stdout);
+	}
+}
+
 
-		(void)list_insert_head(LPS[t]->queue_in, &init_event);
-		LPS[t]->state_log_forced = true;
+
+/**
+* This function starts the simulation, once all worker threads have initialized
+* their LPs. It must be called by only one thread per kernel.
+*/
+void SystemStart(void) {
+
+	if(master_kernel()) {
+		printf("done\n");
 	}
 
-	printf("done\n");
+	// Wait for all kernel instances to be ready
+	kernels_barrier();
 
 	initialization_complete();
 
 	// Notify the statistics subsystem that we are now starting the actual simulation
 	statistics_post_other_data(STAT_SIM_START, 1.0);
 
-	printf("****************************\n"
-               "*    Simulation Started    *\n"
-               "****************************\n");
+	if(master_kernel()) {
+		printf("****************************\n"
+		       "*    Simulation Started    *\n"
+		       "****************************\n");
+	}
 }
 
 
@@ -32,6 +32,20 @@
 #define OPT_STATS		19
 #define OPT_SEED		20
 #define OPT_SERIAL		21
+#define OPT_LP_REBALANCE	22
+#define OPT_CHECKPOINTING	23
+#define OPT_KERNELS		24
+#define OPT_ADAPTIVE_GVT	25
+#define OPT_GVT_MEM_LOW		26
+#define OPT_GVT_MEM_HIGH	27
+#define OPT_TIME_WINDOW		28
+#define OPT_ADAPTIVE_WINDOW	29
+#define OPT_BATCH_EVENTS	30
+#define OPT_ADAPTIVE_BATCH	31
+#define OPT_NUMA		32
+#define OPT_INPUT_QUEUE		33
+#define OPT_GVT_ALGORITHM	34
+#define OPT_SNAPSHOT_LOOKUP	35
 
 // TODO: a vector of vector with text name of numerical options, which should be used for parsing options and for displaying names
 // static char *opt_opt[][] = { ... }
@@ -46,7 +60,7 @@ static char *opt_desc[] = {
 	"Non Piece-Wise-Deterministic simulation model. See manpage for accurate description",
 	"Checkpointing interval",
 	"Take only full logs",
-	"Take only incremental logs (still to be released)",
+	"Take incremental logs, forcing a full log periodically",
 	"Autonomic subsystem: set checkpointing interval and log mode automatically at runtime (still to be released)",
 	"Time between two GVT reductions (in milliseconds)",
 	"Termination Detection mode. Supported values: standard, incremental",
@@ -59,7 +73,21 @@ static char *opt_desc[] = {
 	"Verbose execution",
 	"Level of detail in the output statistics",
 	"Manually specify the initial random seed",
-	"Run a serial simulation (using Calendar Queues)"
+	"Run a serial simulation (using Calendar Queues)",
+	"Migrate LPs across worker threads to balance the load every this number of GVT reductions. 0 disables migration",
+	"State saving scheme. Supported values: css, pss, autonomic (PSS with a per-LP interval tuned at every GVT)",
+	"Number of simulation kernel instances (processes) run on this machine, exchanging messages via shared memory",
+	"Adapt the time between two GVT reductions to memory pressure and to the effectiveness of fossil collection",
+	"Adaptive GVT: below this amount of log memory (in KB) per thread and GVT interval, the period can be lengthened",
+	"Adaptive GVT: above this amount of log memory (in KB) per thread and GVT interval, the period is shortened",
+	"Optimism throttling: do not execute events beyond GVT plus this amount of simulation time. 0 means no throttling",
+	"Adapt the optimism window at each GVT reduction, starting from time_window, on the observed efficiency and rollbacks",
+	"Maximum number of events executed in a row by a LP, as long as no other LP has a smaller timestamp. 1 disables batching",
+	"Adapt the number of events executed in a row at each GVT reduction, starting from batch_events, on the observed rollbacks",
+	"Pin worker threads to cores and place LPs' memory on the NUMA node of the thread hosting them",
+	"Data structure for LPs' input queues. Supported values: list, skiplist (a list indexed by a skiplist, for long queues)",
+	"GVT reduction algorithm. Supported values: phases, single_pass (one pass per thread, single kernel only)",
+	"Give OnGVT the committed root state straight from the time barrier log, without restoring it. OnGVT must not write it nor follow pointers in it"
 };
 
 
@@ -86,12 +114,27 @@ static struct option long_options[] = {
 	{"seed",		required_argument,	0, OPT_SEED},
 	{"serial",		no_argument,		0, OPT_SERIAL},
 	{"sequential",		no_argument,		0, OPT_SERIAL},
+	{"lp_rebalance_cycles",	required_argument,	0, OPT_LP_REBALANCE},
+	{"checkpointing",	required_argument,	0, OPT_CHECKPOINTING},
+	{"kernels",		required_argument,	0, OPT_KERNELS},
+	{"adaptive_gvt",	no_argument,		0, OPT_ADAPTIVE_GVT},
+	{"gvt_mem_low",		required_argument,	0, OPT_GVT_MEM_LOW},
+	{"gvt_mem_high",	required_argument,	0, OPT_GVT_MEM_HIGH},
+	{"time_window",		required_argument,	0, OPT_TIME_WINDOW},
+	{"adaptive_window",	no_argument,		0, OPT_ADAPTIVE_WINDOW},
+	{"batch_events",	required_argument,	0, OPT_BATCH_EVENTS},
+	{"adaptive_batch",	no_argument,		0, OPT_ADAPTIVE_BATCH},
+	{"numa",		no_argument,		0, OPT_NUMA},
+	{"input_queue",		required_argument,	0, OPT_INPUT_QUEUE},
+	{"gvt_algorithm",	required_argument,	0, OPT_GVT_ALGORITHM},
+	{"snapshot_lookup",	no_argument,		0, OPT_SNAPSHOT_LOOKUP},
 	{0,			0,			0, 0}
 };
 
 #else /* _INIT_FROM_MAIN */
 
 extern void SystemInit(int argc, char **argv);
+extern void SystemStart(void);
 
 #endif
 
@@ -0,0 +1,191 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+* @file hash.c
+* @brief This module implements a general-purpose hash table, mapping 64-bit
+* 	 keys to pointers. Collisions are resolved by linear probing, and
+* 	 deletions use backward shifting, so that no tombstone is ever left.
+* 	 The table is not thread-safe.
+*/
+
+#include <string.h>
+
+#include <datatypes/hash.h>
+#include <mm/malloc.h>
+
+
+/// Scramble the key bits, so that keys with regular patterns spread over the table
+static inline unsigned int hash_key(unsigned long long key, unsigned int size) {
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return (unsigned int)key & (size - 1);
+}
+
+
+
+static void hash_table_resize(hash_table *h, unsigned int new_size) {
+	struct hash_bucket *old_buckets = h->buckets;
+	unsigned int old_size = h->size;
+	unsigned int i;
+
+	h->size = new_size;
+	h->count = 0;
+	h->buckets = rsalloc(sizeof(struct hash_bucket) * new_size);
+	bzero(h->buckets, sizeof(struct hash_bucket) * new_size);
+
+	for(i = 0; i < old_size; i++) {
+		if(old_buckets[i].value != NULL) {
+			hash_table_insert(h, old_buckets[i].key, old_buckets[i].value);
+		}
+	}
+
+	rsfree(old_buckets);
+}
+
+
+
+/**
+* This function creates a new, empty, hash table
+*
+* @return A pointer to the new hash table
+*/
+hash_table *new_hash_table(void) {
+	hash_table *h = rsalloc(sizeof(hash_table));
+
+	h->size = HASH_INIT_SIZE;
+	h->count = 0;
+	h->buckets = rsalloc(sizeof(struct hash_bucket) * HASH_INIT_SIZE);
+	bzero(h->buckets, sizeof(struct hash_bucket) * HASH_INIT_SIZE);
+
+	return h;
+}
+
+
+
+/**
+* This function releases all the memory used by a hash table. Values are not free'd.
+*
+* @param h The hash table to destroy
+*/
+void hash_table_destroy(hash_table *h) {
+	rsfree(h->buckets);
+	rsfree(h);
+}
+
+
+
+/**
+* This function associates a value to a key. If the key is already present,
+* the value is replaced. The table is doubled when it gets half full.
+*
+* @param h The hash table
+* @param key The key
+* @param value The value to associate to the key. It must not be NULL.
+*/
+void hash_table_insert(hash_table *h, unsigned long long key, void *value) {
+	unsigned int i;
+
+	if(2 * (h->count + 1) > h->size) {
+		hash_table_resize(h, h->size * 2);
+	}
+
+	i = hash_key(key, h->size);
+	while(h->buckets[i].value != NULL) {
+		if(h->buckets[i].key == key) {
+			h->buckets[i].value = value;
+			return;
+		}
+		i = (i + 1) & (h->size - 1);
+	}
+
+	h->buckets[i].key = key;
+	h->buckets[i].value = value;
+	h->count++;
+}
+
+
+
+/**
+* This function retrieves the value associated with a key
+*
+* @param h The hash table
+* @param key The key to look for
+* @return The value associated with the key, or NULL if the key is not present
+*/
+void *hash_table_lookup(hash_table *h, unsigned long long key) {
+	unsigned int i = hash_key(key, h->size);
+
+	while(h->buckets[i].value != NULL) {
+		if(h->buckets[i].key == key) {
+			return h->buckets[i].value;
+		}
+		i = (i + 1) & (h->size - 1);
+	}
+
+	return NULL;
+}
+
+
+
+/**
+* This function removes a key from the hash table. The following entries of the
+* same cluster are shifted back, so that lookups never stop on a hole.
+*
+* @param h The hash table
+* @param key The key to remove
+* @return The value which was associated with the key, or NULL if the key was not present
+*/
+void *hash_table_remove(hash_table *h, unsigned long long key) {
+	unsigned int i, j, home;
+	void *value;
+
+	i = hash_key(key, h->size);
+	while(h->buckets[i].value != NULL && h->buckets[i].key != key) {
+		i = (i + 1) & (h->size - 1);
+	}
+
+	if(h->buckets[i].value == NULL) {
+		return NULL;
+	}
+
+	value = h->buckets[i].value;
+	h->count--;
+
+	// Backward shift deletion
+	j = i;
+	while(true) {
+		h->buckets[i].value = NULL;
+
+		do {
+			j = (j + 1) & (h->size - 1);
+			if(h->buckets[j].value == NULL) {
+				return value;
+			}
+			home = hash_key(h->buckets[j].key, h->size);
+		// Skip the entries whose home bucket lies cyclically in (i, j]
+		} while(i <= j ? (i < home && home <= j) : (i < home || home <= j));
+
+		h->buckets[i] = h->buckets[j];
+		i = j;
+	}
+}
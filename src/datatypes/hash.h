@@ -0,0 +1,56 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+* @file hash.h
+* @brief This header defines a general-purpose hash table, mapping 64-bit keys
+* 	 to pointers. It is used, e.g., to index messages by their mark.
+*/
+#pragma once
+#ifndef __HASH_DATATYPE_H
+#define __HASH_DATATYPE_H
+
+#include <stdbool.h>
+
+
+/// Initial number of buckets of a hash table (must be a power of 2)
+#define HASH_INIT_SIZE	16
+
+
+/// A bucket of the hash table. A NULL value marks an empty bucket.
+struct hash_bucket {
+	unsigned long long	key;
+	void			*value;
+};
+
+/// A hash table using open addressing with linear probing
+typedef struct _hash_table {
+	unsigned int		size;	/// Number of buckets (always a power of 2)
+	unsigned int		count;	/// Number of used buckets
+	struct hash_bucket	*buckets;
+} hash_table;
+
+
+extern hash_table *new_hash_table(void);
+extern void hash_table_destroy(hash_table *h);
+extern void hash_table_insert(hash_table *h, unsigned long long key, void *value);
+extern void *hash_table_lookup(hash_table *h, unsigned long long key);
+extern void *hash_table_remove(hash_table *h, unsigned long long key);
+
+#endif /* __HASH_DATATYPE_H */
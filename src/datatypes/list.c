@@ -29,6 +29,7 @@
 
 #include <datatypes/list.h>
 #include <mm/malloc.h>
+#include <mm/slab.h>
 
 
 /**
@@ -65,7 +66,7 @@ char *__list_insert_head(void *li, unsigned int size, void *data) {
 	struct rootsim_list_node *new_n;
 
 	// Create the new node and populate the entry
-	new_n = rsalloc(sizeof(struct rootsim_list_node) + size);
+	new_n = slab_alloc(sizeof(struct rootsim_list_node) + size);
 	bzero(new_n, sizeof(struct rootsim_list_node) + size);
 	memcpy(&new_n->data, data, size);
 
@@ -125,7 +126,7 @@ char *__list_insert_tail(void *li, unsigned int size, void *data) {
 	struct rootsim_list_node *new_n;
 
 	// Create the new node and populate the entry
-	new_n = rsalloc(sizeof(struct rootsim_list_node) + size);
+	new_n = slab_alloc(sizeof(struct rootsim_list_node) + size);
 	bzero(new_n, sizeof(struct rootsim_list_node) + size);
 	memcpy(&new_n->data, data, size);
 
@@ -187,20 +188,46 @@ void dump_l(struct rootsim_list_node *n, size_t key_position) {
 */
 char *__list_insert(void *li, unsigned int size, size_t key_position, void *data) {
 
+	struct rootsim_list_node *new_n;
+
+	// Create the new node and populate the entry
+	new_n = slab_alloc(sizeof(struct rootsim_list_node) + size);
+	memcpy(&new_n->data, data, size);
+
+	return __list_insert_node(li, key_position, new_n);
+}
+
+
+
+/**
+* This function links an already-allocated node into the specified ordered doubly-linked list.
+* The node's payload must be already populated, and its key is used to keep the list ordered.
+* This allows to move payloads across data structures without any further copy, provided that
+* they are kept in list nodes since their creation (see the list_allocate_node() macro).
+* It is not safe (and not easily readable) to call this function directly. Rather,
+* there is the list_insert_node() macro (defined in <datatypes/list.h>) which sets
+* correctly many parameters, and provides a more useful API.
+*
+* @param li a pointer to the list data strucuture. Note that if passed through the
+*           list_insert_node() macro, the type of the pointer is the same as the content,
+*           but the pointed memory contains a buffer whose actual type is rootsim_list.
+* @param key_position offset (in bytes) of the key field in the data structure kept
+*           by the list. This is used to maintain the list ordered.
+* @param new_n a pointer to the node to be linked into the list. After this call, the node
+*           is owned by the list.
+*
+* @return a pointer to the payload of the node.
+*/
+char *__list_insert_node(void *li, size_t key_position, struct rootsim_list_node *new_n) {
+
 	rootsim_list *l = (rootsim_list *)li;
 
 	assert(l);
 	size_t size_before = l->size;
 
 	struct rootsim_list_node *n;
-	struct rootsim_list_node *new_n;
-
-	double key = get_key(data);
 
-
-	// Create the new node and populate the entry
-	new_n = rsalloc(sizeof(struct rootsim_list_node) + size);
-	memcpy(&new_n->data, data, size);
+	double key = get_key(&new_n->data);
 
 	// Is the list empty?
 	if(l->size == 0) {
@@ -211,10 +238,6 @@ char *__list_insert(void *li, unsigned int size, size_t key_position, void *data
 		goto insert_end;
 	}
 	
-//	printf("\nInserisco %f in %p\n", key, li);
-//	printf("prima: ");
-//	dump_l(l->head, key_position);
-
 	n = l->tail;
 	while(n != NULL && key < get_key(&n->data)) {
 		n = n->prev;
@@ -238,9 +261,6 @@ char *__list_insert(void *li, unsigned int size, size_t key_position, void *data
 		n->next = new_n;
 	}
 	
-//	printf("dopo: ");
-//	dump_l(l->head, key_position);
-	
     insert_end:
 	l->size++;
 	assert(l->size == (size_before + 1));
@@ -249,6 +269,56 @@ char *__list_insert(void *li, unsigned int size, size_t key_position, void *data
 
 
 
+/**
+* This function links an already-allocated node into the specified ordered doubly-linked list,
+* scanning the list forward from a node which is known to have a key not greater than the new
+* one, rather than backwards from the tail. The node ends up in the same position as with
+* __list_insert_node(), i.e. after all the nodes with the same key.
+* It is not safe (and not easily readable) to call this function directly. Rather,
+* there is the list_insert_node_after() macro (defined in <datatypes/list.h>) which sets
+* correctly many parameters, and provides a more useful API.
+*
+* @param li a pointer to the list data strucuture.
+* @param key_position offset (in bytes) of the key field in the data structure kept
+*           by the list. This is used to maintain the list ordered.
+* @param start a node of the list whose key is not greater than the one of new_n. If NULL,
+*           the list is scanned from the tail.
+* @param new_n a pointer to the node to be linked into the list. After this call, the node
+*           is owned by the list.
+*
+* @return a pointer to the payload of the node.
+*/
+char *__list_insert_node_after(void *li, size_t key_position, struct rootsim_list_node *start, struct rootsim_list_node *new_n) {
+
+	rootsim_list *l = (rootsim_list *)li;
+	struct rootsim_list_node *n = start;
+	double key = get_key(&new_n->data);
+
+	if(start == NULL) {
+		return __list_insert_node(li, key_position, new_n);
+	}
+
+	assert(get_key(&start->data) <= key);
+
+	while(n->next != NULL && get_key(&n->next->data) <= key) {
+		n = n->next;
+	}
+
+	new_n->prev = n;
+	new_n->next = n->next;
+	if(n->next != NULL) {
+		n->next->prev = new_n;
+	} else {
+		l->tail = new_n;
+	}
+	n->next = new_n;
+
+	l->size++;
+	return new_n->data;
+}
+
+
+
 
 /**
 * This function extracts an element from the list, if a corresponding key value is
@@ -312,7 +382,7 @@ char *__list_extract(void *li, unsigned int size, double key, size_t key_positio
 			n->next = (void *)0xDEADBEEF;
 			n->prev = (void *)0xDEADBEEF;
 			bzero(n->data, size);
-			rsfree(n);
+			slab_free(n, sizeof(struct rootsim_list_node) + size);
 
 			l->size--;
 			assert(l->size == (size_before - 1));
@@ -423,7 +493,7 @@ char *__list_extract_by_content(void *li, unsigned int size, void *ptr, bool cop
 	n->next = (void *)0xDEADC0DE;
 	n->prev = (void *)0xDEADC0DE;
 	bzero(n->data, size);
-	rsfree(n);
+	slab_free(n, sizeof(struct rootsim_list_node) + size);
 
 	l->size--;
 	assert(l->size == (size_before - 1));
@@ -498,7 +568,7 @@ char *__list_find(void *li, double key, size_t key_position) {
 * @param size the size of the payload of the list. This is automatically set by
 *           the list_insert() macro.
 */
-void list_pop(void *li) {
+void __list_pop(void *li, unsigned int size) {
 
         rootsim_list *l = (rootsim_list *)li;
 
@@ -516,7 +586,7 @@ void list_pop(void *li) {
 		n_next = n->next;
 		n->next = (void *)0xDEFEC8ED;
 		n->prev = (void *)0xDEFEC8ED;
-		rsfree(n);
+		slab_free(n, sizeof(struct rootsim_list_node) + size);
 		n = n_next;
 		l->size--;
 		assert(l->size == (size_before - 1));
@@ -525,10 +595,11 @@ void list_pop(void *li) {
 
 
 // element associated with key is not truncated
-unsigned int __list_trunc(void *li, double key, size_t key_position, unsigned short int direction) {
+// The truncated nodes are handed back to the node pool as a single chain
+unsigned int __list_trunc(void *li, unsigned int size, double key, size_t key_position, unsigned short int direction) {
 
 	struct rootsim_list_node *n;
-	struct rootsim_list_node *n_adjacent;
+	struct rootsim_list_node *last = NULL;
 	rootsim_list *l = (rootsim_list *)li;
 	unsigned int deleted = 0;
 
@@ -549,11 +620,12 @@ unsigned int __list_trunc(void *li, double key, size_t key_position, unsigned sh
 	n = l->head;
 	while(n != NULL && get_key(&n->data) < key) {
 		deleted++;
-                n_adjacent = n->next;
-                n->next = (void *)0xBAADF00D;
-                n->prev = (void *)0xBAADF00D;
-                rsfree(n);
-                n = n_adjacent;
+		n->prev = (void *)0xBAADF00D;
+		last = n;
+		n = n->next;
+	}
+	if(deleted > 0) {
+		slab_free_chain(l->head, last, deleted, sizeof(struct rootsim_list_node) + size);
 	}
 	l->head = n;
 	if(l->head != NULL)
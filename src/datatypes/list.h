@@ -35,6 +35,7 @@
 
 #include <core/core.h>
 #include <mm/malloc.h>
+#include <mm/slab.h>
 
 #include <arch/atomic.h>
 
@@ -88,6 +89,22 @@ struct rootsim_list {
 #define list_insert(list, key_name, data) \
 			(__typeof__(list))__list_insert((list), sizeof *(list), my_offsetof((list), key_name), (data))
 
+/// Insert an already-allocated node in the list. Refer to <__list_insert_node>() for a more thorough documentation.
+#define list_insert_node(list, key_name, node) \
+			(__typeof__(list))__list_insert_node((list), my_offsetof((list), key_name), (node))
+
+/// Insert an already-allocated node in the list, scanning forward from start. Refer to <__list_insert_node_after>() for a more thorough documentation.
+#define list_insert_node_after(list, key_name, start, node) \
+			(__typeof__(list))__list_insert_node_after((list), my_offsetof((list), key_name), (start), (node))
+
+/// Allocate a list node able to host a payload of the given size, which is not linked to any list yet
+#define list_allocate_node(list) \
+			(struct rootsim_list_node *)slab_alloc(sizeof(struct rootsim_list_node) + sizeof *(list))
+
+/// Release a list node obtained from list_allocate_node() which has not been linked to any list
+#define list_release_node(list, node) \
+			slab_free((node), sizeof(struct rootsim_list_node) + sizeof *(list))
+
 /// Remove a node in the list. Refer to <__list_delete>() for a more thorough documentation.
 #define list_delete(list, key_name, key_value) \
 		__list_delete((list), sizeof *(list), (double)(key_value), my_offsetof((list), key_name))
@@ -117,13 +134,17 @@ struct rootsim_list {
 #define LIST_TRUNC_AFTER	10
 #define LIST_TRUNC_BEFORE	11
 
+/// Remove the first node of the list. Refer to <__list_pop>() for a more thorough documentation.
+#define list_pop(list) \
+		__list_pop((list), sizeof *(list))
+
 /// Truncate a list up to a certain point, towards increasing values. Refer to <__list_trunc>() for a more thorough documentation.
 #define list_trunc_before(list, key_name, key_value) \
-		__list_trunc((list), (double)(key_value), my_offsetof((list), key_name), LIST_TRUNC_BEFORE)
+		__list_trunc((list), sizeof *(list), (double)(key_value), my_offsetof((list), key_name), LIST_TRUNC_BEFORE)
 
 /// Truncate a list from a certain point, towards increasing values. Refer to <__list_trunc>() for a more thorough documentation.
 #define list_trunc_after(list, key_name, key_value) \
-		__list_trunc((list), (double)(key_value), my_offsetof((list), key_name), LIST_TRUNC_AFTER)
+		__list_trunc((list), sizeof *(list), (double)(key_value), my_offsetof((list), key_name), LIST_TRUNC_AFTER)
 
 
 // Get the size of the current list. Refer to <__list_delete>() for a more thorough documentation.
@@ -227,12 +248,14 @@ struct rootsim_list {
 extern char *__list_insert_head(void *li, unsigned int size, void *data);
 extern char *__list_insert_tail(void *li, unsigned int size, void *data);
 extern char *__list_insert(void *li, unsigned int size, size_t key_position, void *data);
+extern char *__list_insert_node(void *li, size_t key_position, struct rootsim_list_node *new_n);
+extern char *__list_insert_node_after(void *li, size_t key_position, struct rootsim_list_node *start, struct rootsim_list_node *new_n);
 extern char *__list_extract(void *li, unsigned int size, double key, size_t key_position);
 extern bool __list_delete(void *li, unsigned int size, double key, size_t key_position);
 extern char *__list_extract_by_content(void *li, unsigned int size, void *ptr, bool copy);
 extern char *__list_find(void *li, double key, size_t key_position);
-extern unsigned int __list_trunc(void *li, double key, size_t key_position, unsigned short int direction);
-extern void list_pop(void *li);
+extern unsigned int __list_trunc(void *li, unsigned int size, double key, size_t key_position, unsigned short int direction);
+extern void __list_pop(void *li, unsigned int size);
 
 #endif /* __LIST_DATATYPE_H */
 
@@ -0,0 +1,216 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+*
+* @file skiplist.c
+* @brief This module implements a skiplist which indexes a subset of the nodes of an
+* 	 ordered list. The index tells, in logarithmic time, a node of the list from
+* 	 which a new node can be linked after a short forward scan, so that inserting
+* 	 far from the tail does not require scanning the whole list. Nodes are not
+* 	 moved, so pointers to their payloads remain valid.
+* 	 Whether a node is indexed, and at how many levels, is derived from its
+* 	 address, so that no random number generator is used. The index is not
+* 	 thread-safe.
+*/
+
+#include <string.h>
+
+#include <datatypes/skiplist.h>
+#include <core/core.h>
+#include <mm/malloc.h>
+#include <mm/slab.h>
+
+
+/// The size of a tower linked at the given number of levels
+#define tower_size(height)	(sizeof(struct skip_tower) + (height) * sizeof(struct skip_tower *))
+
+
+/**
+* This function tells at how many levels a list node is indexed. One node out of
+* 2^SKIP_INDEX_SPACING_BITS is indexed, and each further level holds one fourth of
+* the towers of the previous one.
+*
+* @param node The list node
+* @return The height of the node's tower, 0 if the node is not indexed
+*/
+static inline unsigned int tower_height(struct rootsim_list_node *node) {
+	unsigned long long h = (unsigned long long)node;
+	unsigned int height = 1;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+
+	if(h & ((1ULL << SKIP_INDEX_SPACING_BITS) - 1)) {
+		return 0;
+	}
+
+	h >>= SKIP_INDEX_SPACING_BITS;
+	while(height < SKIP_INDEX_LEVELS && (h & 3) == 0) {
+		height++;
+		h >>= 2;
+	}
+
+	return height;
+}
+
+
+
+/**
+* This function creates a new, empty, skiplist
+*
+* @return A pointer to the new skiplist
+*/
+skip_index *new_skip_index(void) {
+	skip_index *idx = rsalloc(sizeof(skip_index));
+
+	bzero(idx, sizeof(skip_index));
+	return idx;
+}
+
+
+
+/**
+* This function releases all the memory used by a skiplist. Indexed nodes are not free'd.
+*
+* @param idx The skiplist to destroy
+*/
+void skip_index_destroy(skip_index *idx) {
+	struct skip_tower *t, *next;
+
+	for(t = idx->head[0]; t != NULL; t = next) {
+		next = t->next[0];
+		slab_free(t, tower_size(t->height));
+	}
+
+	rsfree(idx);
+}
+
+
+
+/**
+* This function finds where a node with the given key must be linked into the indexed
+* list, and indexes the node if it is selected to be. The node must be linked into the
+* list right after this call, scanning forward from the returned node, which comes after
+* all the indexed nodes with a smaller or equal key (see list_insert_node_after()).
+*
+* @param idx The skiplist
+* @param key The key of the node
+* @param node The list node which is going to be linked into the list
+* @return The last indexed node whose key is not greater than key, or NULL if there is none
+*/
+struct rootsim_list_node *skip_index_insert(skip_index *idx, double key, struct rootsim_list_node *node) {
+	struct skip_tower **update[SKIP_INDEX_LEVELS];
+	struct skip_tower **next = idx->head;
+	struct skip_tower *pred = NULL;
+	struct skip_tower *t;
+	unsigned int l, height;
+
+	for(l = SKIP_INDEX_LEVELS; l-- > 0;) {
+		while(next[l] != NULL && next[l]->key <= key) {
+			pred = next[l];
+			next = pred->next;
+		}
+		update[l] = &next[l];
+	}
+
+	height = tower_height(node);
+	if(height > 0) {
+		t = slab_alloc(tower_size(height));
+		t->key = key;
+		t->node = node;
+		t->height = height;
+		for(l = 0; l < height; l++) {
+			t->next[l] = *update[l];
+			*update[l] = t;
+		}
+		idx->count++;
+	}
+
+	return pred == NULL ? NULL : pred->node;
+}
+
+
+
+/**
+* This function drops a node from the skiplist, if it is indexed. It must be called
+* before the node is removed from the indexed list.
+*
+* @param idx The skiplist
+* @param key The key of the node
+* @param node The list node which is going to be removed from the list
+*/
+void skip_index_remove(skip_index *idx, double key, struct rootsim_list_node *node) {
+	struct skip_tower **update[SKIP_INDEX_LEVELS];
+	struct skip_tower **next = idx->head;
+	struct skip_tower **slot;
+	struct skip_tower *t;
+	unsigned int l;
+
+	for(l = SKIP_INDEX_LEVELS; l-- > 0;) {
+		while(next[l] != NULL && next[l]->key < key) {
+			next = next[l]->next;
+		}
+		update[l] = &next[l];
+	}
+
+	// Several nodes might have the same key
+	t = *update[0];
+	while(t != NULL && D_EQUAL(t->key, key) && t->node != node) {
+		t = t->next[0];
+	}
+	if(t == NULL || t->node != node) {
+		return;
+	}
+
+	for(l = 0; l < t->height; l++) {
+		slot = update[l];
+		while(*slot != t) {
+			slot = &(*slot)->next[l];
+		}
+		*slot = t->next[l];
+	}
+
+	idx->count--;
+	slab_free(t, tower_size(t->height));
+}
+
+
+
+/**
+* This function drops from the skiplist all the nodes whose key is smaller than the
+* given one. It must be called when the indexed list is truncated (see list_trunc_before()).
+*
+* @param idx The skiplist
+* @param key Nodes with a key smaller than this are dropped
+*/
+void skip_index_trunc_before(skip_index *idx, double key) {
+	struct skip_tower *t;
+	unsigned int l;
+
+	// The first tower is the first one at all the levels it is linked at
+	while((t = idx->head[0]) != NULL && t->key < key) {
+		for(l = 0; l < t->height; l++) {
+			idx->head[l] = t->next[l];
+		}
+		idx->count--;
+		slab_free(t, tower_size(t->height));
+	}
+}
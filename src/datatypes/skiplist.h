@@ -0,0 +1,60 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+* @file skiplist.h
+* @brief This header defines a skiplist which indexes the nodes of an ordered list,
+* 	 so that the position of a new node can be found without scanning the list.
+*/
+#pragma once
+#ifndef __SKIPLIST_DATATYPE_H
+#define __SKIPLIST_DATATYPE_H
+
+#include <datatypes/list.h>
+
+
+/// Maximum number of levels of a skiplist
+#define SKIP_INDEX_LEVELS	16
+
+/// One list node out of 2^SKIP_INDEX_SPACING_BITS (on average) is indexed
+#define SKIP_INDEX_SPACING_BITS	3
+
+
+/// An indexed list node, linked at the lowest height levels of the skiplist
+struct skip_tower {
+	double			key;	/// The key of the indexed node
+	struct rootsim_list_node *node;	/// The indexed node
+	unsigned int		height;	/// Number of levels the tower is linked at
+	struct skip_tower	*next[];
+};
+
+/// A skiplist indexing a subset of the nodes of an ordered list
+typedef struct _skip_index {
+	struct skip_tower	*head[SKIP_INDEX_LEVELS];
+	unsigned int		count;	/// Number of indexed nodes
+} skip_index;
+
+
+extern skip_index *new_skip_index(void);
+extern void skip_index_destroy(skip_index *idx);
+extern struct rootsim_list_node *skip_index_insert(skip_index *idx, double key, struct rootsim_list_node *node);
+extern void skip_index_remove(skip_index *idx, double key, struct rootsim_list_node *node);
+extern void skip_index_trunc_before(skip_index *idx, double key);
+
+#endif /* __SKIPLIST_DATATYPE_H */
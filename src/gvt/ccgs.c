@@ -28,6 +28,8 @@
 
 #include <stdbool.h>
 #include <core/core.h>
+#include <arch/atomic.h>
+#include <mm/malloc.h>
 #include <mm/dymelor.h>
 #include <mm/state.h>
 #include <communication/communication.h>
@@ -38,35 +40,145 @@
 
 
 /// This variable is an aggregate result for the distributed termination detection
-static bool ccgs_completed_simulation = false;
+static volatile bool *ccgs_completed_simulation;
 
-/// In case termination detection is incremental, this array keeps track of LPs that think the simulation can be halted already
-static bool lps_termination[MAX_LPs];
+/// In case termination detection is incremental, this array keeps track of LPs that think the simulation can be halted already.
+/// It is indexed by global id, and it is shared by all kernel instances
+static volatile bool *lps_termination;
 
+/// How many LPs in lps_termination think the simulation can be halted. It is shared like lps_termination
+static atomic_t *terminated_lps;
+
+/// Positions in LPS_bound of the LPs which the calling thread has still to ask whether the simulation can be halted
+static __thread unsigned int *check_list = NULL;
+
+/// Number of entries in check_list
+static __thread unsigned int check_count = 0;
+
+
+
+/**
+* Initialization of the CCGS subsystem. Termination results are kept in memory which
+* is shared by all kernel instances, so that any of them can reduce them.
+*/
+void ccgs_init(void) {
+	ccgs_completed_simulation = shm_alloc(sizeof(bool));
+	lps_termination = shm_alloc(sizeof(bool) * n_prc_tot);
+	terminated_lps = shm_alloc(sizeof(atomic_t));
+}
+
+
+
+/**
+* This function rebuilds the list of the bound LPs which are asked whether the simulation
+* can be halted. It must be called whenever LPS_bound changes. If termination detection is
+* incremental, LPs which have already agreed are left out.
+*/
+void ccgs_rebuild_check_list(void) {
+	unsigned int i;
+
+	check_list = rsrealloc(check_list, sizeof(unsigned int) * (n_prc_per_thread > 0 ? n_prc_per_thread : 1));
+	check_count = 0;
+
+	for(i = 0; i < n_prc_per_thread; i++) {
+		if(rootsim_config.check_termination_mode == INCR_CKTRM && lps_termination[LidToGid(LPS_bound[i]->lid)]) {
+			continue;
+		}
+		check_list[check_count++] = i;
+	}
+}
 
 
 inline bool ccgs_can_halt_simulation(void) {
-	return ccgs_completed_simulation;
+	return *ccgs_completed_simulation;
+}
+
+
+/**
+* This function reduces the termination results of the LPs which are visible to this
+* kernel instance: all of them if kernels share memory, or the locally hosted ones if
+* kernels are the ranks of an MPI job (in which case the result must be further reduced
+* across kernels). Worker threads keep the number of LPs which agree up to date, so
+* this takes constant time.
+*
+* @return true if all the visible LPs agree that the simulation can be halted
+*/
+bool ccgs_local_termination(void) {
+	if(mpi_is_initialized) {
+		return (unsigned int)atomic_read(terminated_lps) == n_prc;
+	}
+
+	return (unsigned int)atomic_read(terminated_lps) == n_prc_tot;
+}
+
+
+/**
+* Set the aggregate result of the termination detection, once it has been reduced
+* across all kernel instances
+*
+* @param termination true if the simulation can be halted
+*/
+void ccgs_set_termination(bool termination) {
+	*ccgs_completed_simulation = termination;
 }
 
 
 // Deve essere chiamata da un solo thread al GVT
 void ccgs_reduce_termination(void) {
-	register unsigned int i;
-	bool termination = true;
-		
-	for(i = 0; i < n_prc; i++) {
-		termination &= lps_termination[i];
-	}
-	
-	ccgs_completed_simulation = termination;
+	*ccgs_completed_simulation = ccgs_local_termination();
+}
+
+
+/**
+* This function checks termination on the committed state of a LP by actually restoring
+* it. The current state is logged beforehand and restored afterwards. This is the default,
+* as OnGVT() is given a whole consistent state, which it is free to modify.
+*
+* @param lid The local id of the LP
+* @param barrier The time barrier state of the LP
+* @return The result of OnGVT() on the committed state
+*/
+static bool restore_and_check(unsigned int lid, state_t *barrier) {
+	state_t temporary_log;
+	bool termination;
+
+	// Log the current state so that after we can restore it.
+	current_lvt = lvt(lid);
+	temporary_log.log = log_full(lid);
+	temporary_log.state = LPS[lid]->state;
+	temporary_log.base_pointer = LPS[lid]->current_base_pointer;
+
+	// Restore the time barrier state
+	current_lvt = barrier->lvt;
+	log_restore(lid, barrier);
+	LPS[lid]->state = barrier->state;
+	LPS[lid]->current_base_pointer = barrier->base_pointer;
+
+	termination = OnGVT[lid](LidToGid(lid), LPS[lid]->current_base_pointer);
+
+	// Restore the current state
+	current_lvt = LPS[lid]->bound->timestamp;
+	LPS[lid]->state = temporary_log.state;
+	LPS[lid]->current_base_pointer = temporary_log.base_pointer;
+	log_restore(lid, &temporary_log);
+	log_delete(temporary_log.log);
+
+	// Changes since the last log in the chain have been absorbed by the temporary log
+	set_force_full(lid, FORCE_FULL_NEXT);
+
+	return termination;
 }
 
 
 /**
-* This function rebuilds a simulation state aligned to the new GVT for every LP.
-* In this way, each LP is asked (via the OnGVT() callback) to check whether the
-* simulation can
+* This function asks every LP bound to the calling thread (via the OnGVT() callback)
+* whether the simulation can be halted, on the basis of its committed state. This is
+* the state kept in the time barrier log, which is always a full one. By default, the log
+* is restored by restore_and_check(). With --snapshot_lookup, OnGVT() is instead given the
+* copy of the LP's root state found in the log, so the live state is not touched at all:
+* the copy belongs to the log, and pointers in it still refer to the live memory.
+* Every worker thread runs this on its own LPs. The changes in the number of LPs which
+* agree are summed up locally, and then published with a single atomic operation.
 *
 * @author Francesco Quaglia
 * @author Alessandro Pellegrini
@@ -77,69 +189,58 @@ void ccgs_reduce_termination(void) {
 void ccgs_compute_snapshot(state_t *time_barrier_pointer[], simtime_t gvt) {
 
 	bool check_res = true;
-	register unsigned int i;
+	register unsigned int i, j;
 	register unsigned int lid;
+	void *snapshot;
+	bool termination;
+	int terminated_delta = 0;
 
-	state_t temporary_log;
-//	msg_t *realignment_evt;
-	(void)gvt; // This is required in state reconstruction which is currently commented out
+	(void)gvt; // The committed state is not realigned to the GVT
 
-	for(i = 0; i < n_prc_per_thread; i++) {
+	for(j = 0; j < check_count; j++) {
 
+		i = check_list[j];
 		lid = LPS_bound[i]->lid;
 
-		// If termination detection is incremental, we skip the current LP
-		if(rootsim_config.check_termination_mode == INCR_CKTRM && lps_termination[lid]) {
-			continue;
-		}
-
 		if(time_barrier_pointer[i] == NULL)
 			continue;
 
-		// TODO: realign LogState and RestoreState to be compliant with the execution in the committed portion
-
-		// Log the current state so that after we can restore it.
+		// The application might rely on the identity of the running LP
 		current_lp = lid;
-		current_lvt = lvt(lid);		
-		temporary_log.log = log_state(lid);
-		temporary_log.state = LPS[lid]->state;
-		temporary_log.base_pointer = LPS[lid]->current_base_pointer;
-
-		// Restore the time barrier state
 		current_lvt = time_barrier_pointer[i]->lvt;
-		log_restore(lid, time_barrier_pointer[i]);
-		LPS[lid]->state = time_barrier_pointer[i]->state;
-		LPS[lid]->current_base_pointer = time_barrier_pointer[i]->base_pointer;
-
-/*
-		// If the LP is not blocked, we can reconstruct the state exactly to the GVT
-		if(!is_blocked_state(LPS[lid]->state))  {
-			// Realign the state to the current GVT value
-			realignment_evt = list_next(time_barrier_pointer[i]->last_event);
-			while(realignment_evt != NULL && realignment_evt->timestamp < gvt) {
-				realignment_evt = list_next(realignment_evt);
-			}
-
-			// TODO: LPS[lid]->current_base_pointer can be removed as a parameter
-			silent_execution(lid, LPS[lid]->current_base_pointer, list_next(time_barrier_pointer[i]->last_event), realignment_evt);
+
+		// Call the application to check termination. The state found in the log is only the
+		// committed root structure, and belongs to the log: it is used only if explicitly requested
+		snapshot = NULL;
+		if(rootsim_config.snapshot_lookup) {
+			snapshot = log_lookup(time_barrier_pointer[i]->log, time_barrier_pointer[i]->base_pointer);
 		}
-*/
 
-		// Call the application to check termination
-		lps_termination[lid] = OnGVT[lid](LidToGid(lid), LPS[lid]->current_base_pointer);
-		check_res &= lps_termination[lid];
+		if(snapshot != NULL) {
+			termination = OnGVT[lid](LidToGid(lid), snapshot);
+		} else {
+			termination = restore_and_check(lid, time_barrier_pointer[i]);
+		}
+
+		if(termination != lps_termination[LidToGid(lid)]) {
+			terminated_delta += (termination ? 1 : -1);
+			lps_termination[LidToGid(lid)] = termination;
+		}
+		check_res &= termination;
+
+		// If termination detection is incremental, the LP is not asked anymore
+		if(rootsim_config.check_termination_mode == INCR_CKTRM && termination) {
+			check_list[j--] = check_list[--check_count];
+		}
 
 		// Early stop
 		if(rootsim_config.check_termination_mode == INCR_CKTRM && !check_res) {
 			break;
 		}
+	}
 
-		// Restore the current state
-		current_lvt = LPS[lid]->bound->timestamp;
-		LPS[lid]->state = temporary_log.state;
-		LPS[lid]->current_base_pointer = temporary_log.base_pointer;
-		log_restore(lid, &temporary_log);
-		log_delete(temporary_log.log);
+	if(terminated_delta != 0) {
+		atomic_add(terminated_lps, terminated_delta);
 	}
 
 	// No real LP is running now!
@@ -147,4 +248,3 @@ void ccgs_compute_snapshot(state_t *time_barrier_pointer[], simtime_t gvt) {
 	current_lvt = -1.0;
 
 }
-
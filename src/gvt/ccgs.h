@@ -37,8 +37,12 @@
 
 #include <mm/state.h>
 
+extern void ccgs_init(void);
+extern void ccgs_rebuild_check_list(void);
 extern inline bool ccgs_can_halt_simulation(void);
 extern void ccgs_reduce_termination(void);
+extern bool ccgs_local_termination(void);
+extern void ccgs_set_termination(bool termination);
 extern void ccgs_compute_snapshot(state_t *time_barrier_pointer[], simtime_t gvt);
 
 #endif /* __CCGS_H */
@@ -20,59 +20,131 @@
 *
 * @file fossil.c
 * @brief In this module all the housekeeping operations related to GVT computation phase
-* 	 are present.
+* 	 are present. Upon a new GVT, the time barrier of each bound LP is recorded, and
+* 	 the LPs are then fossil collected a few at a time, from the main loop, so that
+* 	 GVT rounds do not stall worker threads.
 * @author Alessandro Pellegrini
 */
 
 
 
 #include <arch/thread.h>
+#include <core/timer.h>
 #include <gvt/gvt.h>
 #include <gvt/ccgs.h>
 #include <mm/state.h>
+#include <communication/communication.h>
 #include <scheduler/process.h>
 #include <statistics/statistics.h>
+#include <mm/dymelor.h>
 
 
 /// Counter for the invocations of adopt_new_gvt. This is used to determine whether a consistent state must be reconstructed
 static unsigned long long snapshot_cycles;
 
+/// Number of LPs fossil collected at each main loop iteration
+#define FOSSIL_BATCH_LPS	4
+
+/// The next bound LP to be fossil collected by the calling thread
+static __thread unsigned int fossil_cursor = 0;
+
+/// Memory (in bytes) reclaimed by the calling thread since the last GVT reduction
+static __thread double fossil_reclaimed = 0.0;
+
+/// Wall-clock time (in microseconds) spent by the calling thread in fossil collection since the last GVT reduction
+static __thread double fossil_pause = 0.0;
+
 /**
 * Determine which snapshots in the state queue can be free'd because are placed before the current time barrier.
 *
 * Queues are cleaned by deleting all the events the timestamp of which is STRICTLY lower than the time barrier.
 * Since state_pointer points to an event in queue_in, the state queue must be cleaned after the input queue.
+* Committed events are not accounted here, as they have already been counted by adopt_new_gvt().
 *
 * @author Francesco Quaglia
 *
 * @param lid The logical process' local identifier
-* @param time_barrier The current barrier
+* @param time_barrier The state which is going to become the head of the state queue
+* @return The amount of memory (in bytes) which has been released
 */
-void fossil_collection(unsigned int lid, simtime_t time_barrier) {
+static double fossil_collection(unsigned int lid, state_t *time_barrier) {
 	state_t *state;
 	msg_t *last_kept_event;
-	double committed_events;
-	
-	time_barrier = 0.7 * time_barrier;
+	msg_t *evt;
+	double reclaimed = 0.0;
 
 	// State list must be handled differently, as nodes point to malloc'd
 	// nodes. We therefore manually scan the list and free the memory.
-	while( (state = list_head(LPS[lid]->queue_states)) != NULL && state->lvt < time_barrier) {
+	while( (state = list_head(LPS[lid]->queue_states)) != NULL && state != time_barrier) {
+		reclaimed += (double)get_log_size(state->log) + sizeof(state_t);
 		log_delete(list_head(LPS[lid]->queue_states)->log);
 		state->last_event = (void *)0xDEADBABE;
 		list_pop(LPS[lid]->queue_states);
 	}
 
 	// Determine queue pruning horizon
-	last_kept_event = list_head(LPS[lid]->queue_states)->last_event;
+	last_kept_event = time_barrier->last_event;
+
+	// Events which are going to be discarded cannot be annihilated anymore: drop them from the index
+	// and release their out-of-line payloads, which list_trunc_before() knows nothing about
+	for(evt = list_head(LPS[lid]->queue_in); evt != NULL && evt->timestamp < last_kept_event->timestamp; evt = list_next(evt)) {
+		(void)hash_table_remove(LPS[lid]->mark_index, evt->mark);
+		msg_release_content(evt);
+	}
+
+	if(LPS[lid]->queue_in_index != NULL) {
+		skip_index_trunc_before(LPS[lid]->queue_in_index, last_kept_event->timestamp);
+	}
 
 	// Truncate the input queue, accounting for the event which is pointed by the lastly kept state
-	committed_events = (double)list_trunc_before(LPS[lid]->queue_in, timestamp, last_kept_event->timestamp);
-	statistics_post_lp_data(lid, STAT_COMMITTED, committed_events);
+	reclaimed += (double)list_trunc_before(LPS[lid]->queue_in, timestamp, last_kept_event->timestamp) * sizeof(msg_t);
 
 	// Truncate the output queue
-	list_trunc_before(LPS[lid]->queue_out, send_time, last_kept_event->timestamp);
+	reclaimed += (double)list_trunc_before(LPS[lid]->queue_out, send_time, last_kept_event->timestamp) * sizeof(msg_hdr_t);
+
+	return reclaimed;
+}
+
+
 
+/**
+* Fossil collect a single LP up to the barrier recorded for it, if any.
+*
+* @param lp The LP to be collected
+*/
+static void fossil_collect_LP(LP_state *lp) {
+	if(lp->fossil_barrier == NULL) {
+		return;
+	}
+
+	// Execute the fossil collection
+	fossil_reclaimed += fossil_collection(lp->lid, lp->fossil_barrier);
+
+	// Actually release memory buffer allocated by the LPs and then released via free() calls
+	clean_buffers_on_gvt(lp->lid, lp->fossil_barrier->lvt);
+
+	lp->fossil_barrier = NULL;
+}
+
+
+
+/**
+* Count the events of an LP which are committed by a time barrier, i.e. the ones
+* which the next fossil collection of the LP will discard from the input queue.
+*
+* @param lp The LP
+* @param time_barrier The state which is going to become the head of the state queue
+* @return The number of committed events
+*/
+static double count_committed_events(LP_state *lp, state_t *time_barrier) {
+	msg_t *evt;
+	double committed_events = 0.0;
+
+	for(evt = list_head(lp->queue_in); evt != NULL && evt->timestamp < time_barrier->last_event->timestamp; evt = list_next(evt)) {
+		committed_events++;
+	}
+
+	return committed_events;
 }
 
 
@@ -80,6 +152,9 @@ void fossil_collection(unsigned int lid, simtime_t time_barrier) {
 /**
 * This function is used by Master and Slave Kernels to determine the time barrier
 * and perform some housekeeping once the new GVT value has been computed.
+* Fossil collection is not run here: the time barrier of each bound LP is recorded,
+* and fossil_collection_step() does the actual work later on. Committed events are
+* instead counted here, so that they are reported along with the GVT which commits them.
 *
 * @author Francesco Quaglia
 */
@@ -88,6 +163,7 @@ void adopt_new_gvt(simtime_t new_gvt, simtime_t new_min_barrier) {
 
 	state_t *time_barrier_pointer[n_prc_per_thread];
 	bool compute_snapshot;
+	timer drain_timer;
 
 	// Snapshot should be recomputed only periodically
 	snapshot_cycles++;
@@ -103,16 +179,59 @@ void adopt_new_gvt(simtime_t new_gvt, simtime_t new_min_barrier) {
 		ccgs_compute_snapshot(time_barrier_pointer, new_gvt);
 	}
 
+	// LPs which have not been collected yet since the last GVT reduction are collected now,
+	// so that the events counted below have not been counted already
+	timer_start(drain_timer);
 	for(i = 0; i < n_prc_per_thread; i++) {
+		fossil_collect_LP(LPS_bound[i]);
+	}
+	fossil_pause += timer_value_micro(drain_timer);
 
-		if(time_barrier_pointer[i] == NULL)
-			continue;
-
-		// Execute the fossil collection
-		fossil_collection(LPS_bound[i]->lid, time_barrier_pointer[i]->lvt);
+	// Report what fossil collection has done since the last GVT reduction
+	statistics_post_other_data(STAT_FOSSIL_MEMORY, fossil_reclaimed);
+	statistics_post_other_data(STAT_FOSSIL_TIME, fossil_pause);
+	fossil_reclaimed = 0.0;
+	fossil_pause = 0.0;
 
-		// Actually release memory buffer allocated by the LPs and then released via free() calls
-		clean_buffers_on_gvt(LPS_bound[i]->lid, time_barrier_pointer[i]->lvt);
+	for(i = 0; i < n_prc_per_thread; i++) {
+		if(time_barrier_pointer[i] != NULL) {
+			statistics_post_lp_data(LPS_bound[i]->lid, STAT_COMMITTED, count_committed_events(LPS_bound[i], time_barrier_pointer[i]));
+			LPS_bound[i]->fossil_barrier = time_barrier_pointer[i];
+		}
 	}
+	fossil_cursor = 0;
 }
 
+
+
+/**
+* This function fossil collects a bounded number of the LPs bound to the calling thread,
+* up to the time barrier recorded for them upon the last GVT reduction. It is called
+* at every iteration of the main loop, so that the work is spread over the GVT interval.
+* LPs migrated in the meanwhile are collected by the thread they are bound to at the
+* next GVT reduction.
+*/
+void fossil_collection_step(void) {
+	unsigned int collected = 0;
+	LP_state *lp;
+	timer step_timer;
+
+	if(fossil_cursor >= n_prc_per_thread) {
+		return;
+	}
+
+	timer_start(step_timer);
+
+	while(fossil_cursor < n_prc_per_thread && collected < FOSSIL_BATCH_LPS) {
+		lp = LPS_bound[fossil_cursor++];
+
+		if(lp->fossil_barrier == NULL) {
+			continue;
+		}
+
+		fossil_collect_LP(lp);
+		collected++;
+	}
+
+	fossil_pause += timer_value_micro(step_timer);
+}
@@ -21,6 +21,23 @@
 * @file gvt.c
 * @brief This module implements the GVT reduction. The current implementation
 * 	 is non blocking for observable simulation plaftorms.
+* 	 Worker threads of kernels sharing memory reduce their minima through the
+* 	 phases below. If kernels are the ranks of an MPI job, the master thread of
+* 	 each kernel additionally carries on a non-blocking reduction across ranks:
+* 	 it waits for the messages sent before the local threads entered the round
+* 	 to be received everywhere (see window.c), and then reduces the kernel minima.
+* 	 Within a single kernel, a single-pass reduction can be used instead
+* 	 (see rootsim_config.gvt_algorithm): every thread reports its local minimum
+* 	 only once per round. The minimum is kept up to date as events are scheduled
+* 	 (by the ready queue of the STF scheduler) and sent (by gvt_message_sent()),
+* 	 so no LP is visited and no time barrier is searched during the reduction.
+* 	 Since messages are delivered atomically into bottom halves, a message is
+* 	 either received by its destination before it reports, or accounted by the
+* 	 sender, which tracks the messages it has sent since its last report
+* 	 (Fujimoto and Hybinette's shared-memory GVT).
+* 	 If the adaptive GVT is enabled, at the end of each reduction every thread
+* 	 votes for the length of the next GVT interval, on the basis of the memory
+* 	 logged by its LPs and of how much fossil collection has reclaimed.
 * @author Alessandro Pellegrini
 * @author Francesco Quaglia
 */
@@ -32,8 +49,11 @@
 #include <gvt/ccgs.h>
 #include <core/core.h>
 #include <core/timer.h>
+#include <communication/communication.h>
 #include <scheduler/process.h>
 #include <scheduler/scheduler.h> // this is for n_prc_per_thread
+#include <scheduler/stf.h>
+#include <mm/state.h>
 #include <statistics/statistics.h>
 
 
@@ -42,6 +62,18 @@ static bool first_gvt_invocation = true;
 // Defintion of GVT-reduction phases
 enum gvt_phases {phase_A, phase_send, phase_B, phase_aware, phase_end};
 
+/// The adaptive GVT period is kept between the configured one divided by this value...
+#define GVT_PERIOD_MIN_DIVISOR	16
+
+/// ...and the configured one multiplied by this value
+#define GVT_PERIOD_MAX_FACTOR	16
+
+/// Queues of a thread growing by more than this fraction across a GVT interval are a sign of memory pressure
+#define GVT_QUEUES_GROWTH	0.25
+
+/// Fossil collection reclaiming less than this fraction of the queues of a thread is not worth running so often
+#define GVT_LOW_RECLAIM		0.10
+
 
 
 // Timer to know when we have to start GVT computation.
@@ -51,33 +83,53 @@ timer gvt_timer;
 
 
 
-/* Data shared across threads */
+/* Data shared across threads and, if more than one is running, across kernel instances */
+struct gvt_shared {
 
-/// To be used with CAS to determine who is starting the next GVT reduction phase
-static volatile unsigned int current_GVT_round = 0;
+	/// To be used with CAS to determine who is starting the next GVT reduction phase
+	volatile unsigned int current_GVT_round;
 
-/// How many threads have left phase A?
-static atomic_t counter_A;
+	/// How many threads have left phase A?
+	atomic_t counter_A;
 
-/// How many threads have left phase send?
-static atomic_t counter_send;
+	/// How many threads have left phase send?
+	atomic_t counter_send;
 
-/// How many threads have left phase B?
-static atomic_t counter_B;
+	/// How many threads have left phase B?
+	atomic_t counter_B;
 
-/// How many threads are aware that the GVT reduction is over?
-static atomic_t counter_aware;
+	/// How many threads are aware that the GVT reduction is over?
+	atomic_t counter_aware;
 
-/// How many threads have acquired the new GVT?
-static atomic_t counter_end;
+	/// How many threads have acquired the new GVT?
+	atomic_t counter_end;
 
-/** Flag to start a new GVT reduction phase. Explicitly using an int here,
- *  because 'bool' could be compiler dependent, but we must know the size
- *  beforehand, because we're going to use CAS on this. Changing the type could
- *  entail an undefined behaviour. 'false' and 'true' are usually int's (or can be
- *  converted to them by the compiler), so everything should work here.
- */
-static volatile unsigned int GVT_flag = 0;
+	/** Flag to start a new GVT reduction phase. Explicitly using an int here,
+	 *  because 'bool' could be compiler dependent, but we must know the size
+	 *  beforehand, because we're going to use CAS on this. Changing the type could
+	 *  entail an undefined behaviour. 'false' and 'true' are usually int's (or can be
+	 *  converted to them by the compiler), so everything should work here.
+	 */
+	volatile unsigned int GVT_flag;
+
+	/// Wall-clock time (in milliseconds) to wait before starting the next GVT reduction
+	volatile int period;
+
+	/// The period which led to the current GVT reduction
+	volatile int round_period;
+
+	/// Threads which have still to vote for the next period (negative, to elect the last one with atomic_inc_and_test)
+	atomic_t counter_vote;
+
+	/// How many threads asked to shorten the period?
+	atomic_t votes_shorten;
+
+	/// How many threads asked to lengthen the period?
+	atomic_t votes_lengthen;
+};
+
+/// The shared state of the reduction. It lives in shared memory if there are multiple kernels
+static struct gvt_shared *gvt_shared;
 
 /// Pointers to the barrier states of the bound LPs
 static state_t **time_barrier_pointer;
@@ -100,11 +152,60 @@ static __thread enum gvt_phases my_phase = phase_A;
 /// Per-thread GVT round counter
 static __thread unsigned int my_GVT_round = 0;
 
-/// The local (per-thread) minimum. It's not TLS, rather an array, to allow reduction by master thread
+/// Length of the queues of the bound LPs after the last fossil collection, for the adaptive GVT
+static __thread unsigned long retained_queues = 0;
+
+/// Minimum timestamp of the messages sent by the calling thread since it last reported to a single-pass reduction
+static __thread simtime_t sent_min = INFTY;
+
+/// Wall-clock time at which the calling thread entered the current GVT round
+static __thread timer round_timer;
+
+/// The local (per-thread) minimum. It's not TLS, rather an array (with one slot per thread of every kernel), to allow reduction by master thread
 static simtime_t *local_min;
 
 static simtime_t *local_min_barrier;
 
+/// Number of kernel instances sharing the state of the reduction. Over MPI, each kernel has its own
+#define gvt_kernels()	(mpi_is_initialized ? 1 : n_ker)
+
+/// Total number of worker threads taking part in the reduction
+#define gvt_threads()	(gvt_kernels() * n_cores)
+
+/// The slot of the calling thread in the local minima arrays
+#define gvt_slot()	((mpi_is_initialized ? 0 : kid) * n_cores + tid)
+
+
+#ifdef HAVE_MPI
+
+// Definition of the phases of the reduction across MPI ranks
+enum kernel_phases {kernel_idle, kernel_cut, kernel_count, kernel_transient, kernel_local, kernel_reduce, kernel_done};
+
+/// The phase of the reduction across MPI ranks. Only the master thread moves it forward
+static volatile enum kernel_phases kernel_phase = kernel_idle;
+
+/// Messages of the previous epoch sent by this kernel to each kernel, and by all kernels to each kernel
+static unsigned long long epoch_sent[N_KER_MAX], epoch_sent_total[N_KER_MAX];
+
+/// The termination vote of the LPs of this kernel, taken when the round started
+static bool kernel_termination;
+
+/// Kernel minima (GVT, time barrier, termination vote) and their reduction across kernels
+static simtime_t kernel_min[3], global_min[3];
+
+/// Local threads can compute their minima in phase B once no message of the previous epoch is in transit
+#define kernel_transient_done()	(!mpi_is_initialized || kernel_phase >= kernel_local)
+
+/// Local threads can adopt the new GVT once the minima have been reduced across kernels
+#define kernel_reduction_done()	(!mpi_is_initialized || kernel_phase == kernel_done)
+
+#else
+
+#define kernel_transient_done()	true
+#define kernel_reduction_done()	true
+
+#endif
+
 
 /**
 * Initialization of the GVT subsystem
@@ -114,13 +215,16 @@ static simtime_t *local_min_barrier;
 void gvt_init(void) {
 	unsigned int i;
 
-	// This allows the first GVT phase to start
-	atomic_set(&counter_end, 0);
+	// All kernels start from a zeroed shared state: this allows the first GVT phase to start
+	gvt_shared = shm_alloc(sizeof(struct gvt_shared));
+
+	// Every kernel writes the same value here, before the simulation starts
+	gvt_shared->period = rootsim_config.gvt_time_period;
 
 	// Initialize the local minima
-	local_min = rsalloc(sizeof(simtime_t) * n_cores);
-	local_min_barrier = rsalloc(sizeof(simtime_t) * n_cores);
-	for(i = 0; i < n_cores; i++) {
+	local_min = shm_alloc(sizeof(simtime_t) * gvt_threads());
+	local_min_barrier = shm_alloc(sizeof(simtime_t) * gvt_threads());
+	for(i = 0; i < gvt_threads(); i++) {
 		local_min[i] = INFTY;
 		local_min_barrier[i] = INFTY;
 	}
@@ -137,6 +241,9 @@ void gvt_init(void) {
 * @author Alessandro Pellegrini
 */
 void gvt_fini(void){
+	shm_free(local_min_barrier);
+	shm_free(local_min);
+	shm_free(gvt_shared);
 }
 
 
@@ -152,6 +259,185 @@ inline simtime_t get_last_gvt(void) {
 
 
 
+/**
+* This function keeps track of the messages sent by the calling thread, for the
+* single-pass reduction. It is called for every message (and antimessage) which
+* is sent, so it must be cheap.
+*
+* @param timestamp The timestamp of the message being sent
+*/
+void gvt_message_sent(simtime_t timestamp) {
+	if(timestamp < sent_min) {
+		sent_min = timestamp;
+	}
+}
+
+
+
+/**
+* This function computes the local minimum of the calling thread for the single-pass
+* reduction. Bottom halves must have been processed, so that the ready queue knows
+* the smallest unprocessed timestamp of the bound LPs. Messages sent since the last
+* report are accounted as well, and they are forgotten from now on.
+*
+* @return The local minimum of the calling thread
+*/
+static simtime_t single_pass_local_min(void) {
+	simtime_t local_min_time;
+	#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
+	unsigned int i;
+	#endif
+
+	local_min_time = min(stf_min_timestamp(), sent_min);
+	sent_min = INFTY;
+
+	#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
+	// LPs blocked on a synchronization are out of the ready queue, but the event they are processing is not over
+	for(i = 0; i < n_prc_per_thread; i++) {
+		if((is_blocked_state(LPS_bound[i]->state) || LPS_bound[i]->state == LP_STATE_READY_FOR_SYNCH) && LPS_bound[i]->bound != NULL) {
+			local_min_time = min(local_min_time, LPS_bound[i]->bound->timestamp);
+		}
+	}
+	#endif
+
+	return local_min_time;
+}
+
+
+
+/**
+* This function returns the overall length of the input and state queues of the LPs
+* bound to the calling thread.
+*
+* @return The number of messages and states held by the bound LPs
+*/
+static unsigned long bound_queues_length(void) {
+	unsigned int i;
+	unsigned long length = 0;
+
+	for(i = 0; i < n_prc_per_thread; i++) {
+		length += list_sizeof(LPS_bound[i]->queue_in) + list_sizeof(LPS_bound[i]->queue_states);
+	}
+
+	return length;
+}
+
+
+
+/**
+* Adaptive GVT. After fossil collection, each thread votes for the length of the next GVT
+* interval. It asks for a shorter interval if its LPs have logged more memory than the
+* high watermark, or if their queues keep growing, so that memory is recovered earlier.
+* It asks for a longer one if its LPs have logged less memory than the low watermark and
+* fossil collection has reclaimed little, so that fewer reductions are run for nothing.
+* The last thread to vote sets the period: one vote to shorten it is enough, while all
+* threads must agree to lengthen it.
+*
+* @param queued_before The length of the queues of the bound LPs before fossil collection
+*/
+static void adapt_gvt_period(unsigned long queued_before) {
+	unsigned int i;
+	unsigned long queued;
+	double log_memory = 0.0;
+	int period;
+
+	// This is the memory logged in the last GVT interval: statistics have just been posted
+	for(i = 0; i < n_prc_per_thread; i++) {
+		log_memory += statistics_get_lp_data(LPS_bound[i]->lid, STAT_CKPT_MEM);
+	}
+	log_memory /= 1024.0;
+
+	queued = bound_queues_length();
+
+	if(log_memory > rootsim_config.gvt_mem_high || (retained_queues > 0 && queued > retained_queues * (1.0 + GVT_QUEUES_GROWTH))) {
+		atomic_inc(&gvt_shared->votes_shorten);
+	} else if(log_memory < rootsim_config.gvt_mem_low && queued >= queued_before * (1.0 - GVT_LOW_RECLAIM)) {
+		atomic_inc(&gvt_shared->votes_lengthen);
+	}
+
+	retained_queues = queued;
+
+	if(!atomic_inc_and_test(&gvt_shared->counter_vote)) {
+		return;
+	}
+
+	// No thread can start the next reduction before this one has reached phase end
+	period = gvt_shared->period;
+	if(atomic_read(&gvt_shared->votes_shorten) > 0) {
+		period = max(period / 2, rootsim_config.gvt_time_period / GVT_PERIOD_MIN_DIVISOR);
+	} else if((unsigned int)atomic_read(&gvt_shared->votes_lengthen) == gvt_threads()) {
+		period = min(period + period / 2 + 1, rootsim_config.gvt_time_period * GVT_PERIOD_MAX_FACTOR);
+	}
+	gvt_shared->period = max(period, 1);
+}
+
+
+
+#ifdef HAVE_MPI
+/**
+* This function moves forward the reduction across MPI ranks. It is executed by the
+* master thread of each kernel, and it never blocks: collective operations are started
+* and then polled at the following invocations.
+*/
+static void kernel_operations(void) {
+	unsigned int i;
+	unsigned int previous_epoch = (gvt_shared->current_GVT_round + 1) % 2;
+
+	switch(kernel_phase) {
+
+		case kernel_cut:
+			// Once all local threads are in the new epoch, the messages of the previous one are known
+			if(atomic_read(&gvt_shared->counter_A) == 0) {
+				sent_in_epoch(previous_epoch, epoch_sent);
+				mpi_reduce_sent(epoch_sent, epoch_sent_total);
+				kernel_phase = kernel_count;
+			}
+			break;
+
+		case kernel_count:
+			if(mpi_reduction_completed()) {
+				kernel_phase = kernel_transient;
+			}
+			break;
+
+		case kernel_transient:
+			// Local threads can compute their minima only when no message of the previous epoch is in transit towards us
+			messages_checking();
+			if(received_in_epoch(previous_epoch) == epoch_sent_total[kid]) {
+				kernel_phase = kernel_local;
+			}
+			break;
+
+		case kernel_local:
+			if(atomic_read(&gvt_shared->counter_B) == 0) {
+				kernel_min[0] = INFTY;
+				kernel_min[1] = INFTY;
+				kernel_min[2] = (kernel_termination ? 1.0 : 0.0);
+				for(i = 0; i < gvt_threads(); i++) {
+					kernel_min[0] = min(local_min[i], kernel_min[0]);
+					kernel_min[1] = min(local_min_barrier[i], kernel_min[1]);
+				}
+				mpi_reduce_min(kernel_min, global_min, 3);
+				kernel_phase = kernel_reduce;
+			}
+			break;
+
+		case kernel_reduce:
+			if(mpi_reduction_completed()) {
+				ccgs_set_termination(global_min[2] > 0.5);
+				kernel_phase = kernel_done;
+			}
+			break;
+
+		case kernel_idle:
+		case kernel_done:
+			break;
+	}
+}
+#endif
+
+
+
 /**
 * This is the entry point from the main simulation loop to the GVT subsystem.
 * This function is not executed in case of a serial simulation, and is executed
@@ -175,11 +461,12 @@ simtime_t gvt_operations(void) {
 	simtime_t new_gvt;
 	simtime_t new_min_barrier;
 	state_t *tentative_barrier;
+	unsigned long queued;
 
 	// GVT reduction initialization.
 	// This is different from the paper's pseudocode to reduce
 	// slightly the number of clock reads
-	if(GVT_flag == 0 && atomic_read(&counter_end) == 0) {
+	if(gvt_shared->GVT_flag == 0 && atomic_read(&gvt_shared->counter_end) == 0) {
 		
 		
 		// When using ULT, creating stacks might require more time than
@@ -193,95 +480,141 @@ simtime_t gvt_operations(void) {
 		}
 
 		// Has enough time passed since the last GVT reduction?
-		if ( timer_value_milli(gvt_timer) > (int)rootsim_config.gvt_time_period &&
-		    iCAS(&current_GVT_round, my_GVT_round, my_GVT_round + 1)) {
-
-			// Reduce the current CCGS termination detection
-			ccgs_reduce_termination();
+		if ( timer_value_milli(gvt_timer) > gvt_shared->period &&
+		    iCAS(&gvt_shared->current_GVT_round, my_GVT_round, my_GVT_round + 1)) {
+
+			// Reduce the current CCGS termination detection. Over MPI, this
+			// kernel's vote is reduced along with the GVT
+			if(mpi_is_initialized) {
+			#ifdef HAVE_MPI
+				kernel_termination = ccgs_local_termination();
+				kernel_phase = kernel_cut;
+			#endif
+			} else {
+				ccgs_reduce_termination();
+			}
 
-			// Reset atomic counters and make all threads compute the GVT
-			atomic_set(&counter_A, n_cores);
-			atomic_set(&counter_send, n_cores);
-			atomic_set(&counter_B, n_cores);
-			atomic_set(&counter_aware, n_cores);
-			atomic_set(&counter_end, n_cores);
-			GVT_flag = 1;
+			// Reset atomic counters and make all threads compute the GVT.
+			// The single-pass reduction has no phase send and no phase B
+			atomic_set(&gvt_shared->counter_A, gvt_threads());
+			atomic_set(&gvt_shared->counter_send, (rootsim_config.gvt_algorithm == GVT_SINGLE_PASS ? 0 : gvt_threads()));
+			atomic_set(&gvt_shared->counter_B, (rootsim_config.gvt_algorithm == GVT_SINGLE_PASS ? 0 : gvt_threads()));
+			atomic_set(&gvt_shared->counter_aware, gvt_threads());
+			atomic_set(&gvt_shared->counter_end, gvt_threads());
+			atomic_set(&gvt_shared->counter_vote, -(int)gvt_threads());
+			atomic_set(&gvt_shared->votes_shorten, 0);
+			atomic_set(&gvt_shared->votes_lengthen, 0);
+			gvt_shared->round_period = gvt_shared->period;
+			gvt_shared->GVT_flag = 1;
 
 			timer_restart(gvt_timer);
 		}
 	}
 
 
-	if(GVT_flag == 1) {
+	if(gvt_shared->GVT_flag == 1) {
+
+	#ifdef HAVE_MPI
+		if(mpi_is_initialized && master_thread()) {
+			kernel_operations();
+		}
+	#endif
 
 		if(my_phase == phase_A) {
 
 			// Someone has modified the GVT round (possibly me).
 			// Keep track of this update
-			my_GVT_round = current_GVT_round;
+			my_GVT_round = gvt_shared->current_GVT_round;
+			timer_start(round_timer);
+
+			// Messages sent to other kernels from now on belong to the new round
+			start_epoch(my_GVT_round);
 
+			messages_checking();
 			process_bottom_halves();
 
+			// Report once, then wait for the other threads while simulating
+			if(rootsim_config.gvt_algorithm == GVT_SINGLE_PASS) {
+				local_min[gvt_slot()] = single_pass_local_min();
+				local_min_barrier[gvt_slot()] = local_min[gvt_slot()];
+				my_phase = phase_aware;
+				atomic_dec(&gvt_shared->counter_A);
+				return -1.0;
+			}
+
 			for(i = 0; i < n_prc_per_thread; i++) {
 				if(LPS_bound[i]->bound == NULL) {
-					local_min[tid] = 0.0;
-					local_min_barrier[tid] = 0.0;
+					local_min[gvt_slot()] = 0.0;
+					local_min_barrier[gvt_slot()] = 0.0;
 					break;
 				}
 
-				local_min[tid] = min(local_min[tid], LPS_bound[i]->bound->timestamp);
+				local_min[gvt_slot()] = min(local_min[gvt_slot()], LPS_bound[i]->bound->timestamp);
 				tentative_barrier = find_time_barrier(LPS_bound[i]->lid, LPS_bound[i]->bound->timestamp);
-				local_min_barrier[tid] = min(local_min_barrier[tid], tentative_barrier->lvt);
+				local_min_barrier[gvt_slot()] = min(local_min_barrier[gvt_slot()], tentative_barrier->lvt);
 			}
 			my_phase = phase_send;	// Entering phase send
-			atomic_dec(&counter_A);	// Notify finalization of phase A
+			atomic_dec(&gvt_shared->counter_A);	// Notify finalization of phase A
 			return -1.0;
 		}
 
 
-		if(my_phase == phase_send && atomic_read(&counter_A) == 0) {
+		if(my_phase == phase_send && atomic_read(&gvt_shared->counter_A) == 0) {
 			process_bottom_halves();
 			schedule();
 			my_phase = phase_B;
-			atomic_dec(&counter_send);
+			atomic_dec(&gvt_shared->counter_send);
 			return  -1.0;
 		}
 
-		if(my_phase == phase_B && atomic_read(&counter_send) == 0) {
+		if(my_phase == phase_B && atomic_read(&gvt_shared->counter_send) == 0 && kernel_transient_done()) {
+			// Messages sent by other kernels before the end of phase send are now in the bottom halves
+			messages_checking();
 			process_bottom_halves();
 
 			for(i = 0; i < n_prc_per_thread; i++) {
 				if(LPS_bound[i]->bound == NULL) {
-					local_min[tid] = 0.0;
-					local_min_barrier[tid] = 0.0;
+					local_min[gvt_slot()] = 0.0;
+					local_min_barrier[gvt_slot()] = 0.0;
 					break;
 				}
 
-				local_min[tid] = min(local_min[tid], LPS_bound[i]->bound->timestamp);
+				local_min[gvt_slot()] = min(local_min[gvt_slot()], LPS_bound[i]->bound->timestamp);
 				tentative_barrier = find_time_barrier(LPS_bound[i]->lid, LPS_bound[i]->bound->timestamp);
-				local_min_barrier[tid] = min(local_min_barrier[tid], tentative_barrier->lvt);
+				local_min_barrier[gvt_slot()] = min(local_min_barrier[gvt_slot()], tentative_barrier->lvt);
 			}
 
+			// Messages sent to other kernels in this round might still be in transit
+			local_min[gvt_slot()] = min(local_min[gvt_slot()], local_min_timestamp());
+
 			my_phase = phase_aware;
-			atomic_dec(&counter_B);
+			atomic_dec(&gvt_shared->counter_B);
 			return  -1.0;
 		}
 
 
-		if(my_phase == phase_aware && atomic_read(&counter_B) == 0) {
+		if(my_phase == phase_aware && atomic_read(&gvt_shared->counter_A) == 0 && atomic_read(&gvt_shared->counter_B) == 0 && kernel_reduction_done()) {
+			queued = (rootsim_config.adaptive_gvt ? bound_queues_length() : 0);
 			new_gvt = INFTY;
 			new_min_barrier = INFTY;
 
-			for(i = 0; i < n_cores; i++) {
+			for(i = 0; i < gvt_threads(); i++) {
 				new_gvt = min(local_min[i], new_gvt);
 				new_min_barrier = min(local_min_barrier[i], new_min_barrier);
 			}
 
-			atomic_dec(&counter_aware);
+		#ifdef HAVE_MPI
+			if(mpi_is_initialized) {
+				new_gvt = global_min[0];
+				new_min_barrier = global_min[1];
+			}
+		#endif
+
+			atomic_dec(&gvt_shared->counter_aware);
 
-			if(atomic_read(&counter_aware) == 0) {
+			if(atomic_read(&gvt_shared->counter_aware) == 0) {
 				// The last one passing here, resets GVT flag
-				iCAS(&GVT_flag, 1, 0);
+				iCAS(&gvt_shared->GVT_flag, 1, 0);
 			}
 
 			// Execute fossil collection and termination detection
@@ -294,8 +627,30 @@ simtime_t gvt_operations(void) {
 			adopted_last_gvt = new_gvt;
 
 			// Dump statistics
+			statistics_post_other_data(STAT_GVT_PERIOD, gvt_shared->round_period);
+			statistics_post_other_data(STAT_GVT_LATENCY, timer_value_milli(round_timer));
 			statistics_post_other_data(STAT_GVT, new_gvt);
 
+			// Choose the length of the next GVT interval
+			if(rootsim_config.adaptive_gvt) {
+				adapt_gvt_period(queued);
+			}
+
+			// Move the optimism window forward
+			if(rootsim_config.time_window > 0.0) {
+				stf_update_time_window(new_gvt);
+			}
+
+			// Tune the number of events executed in a row on what happened in the last GVT phase
+			if(rootsim_config.adaptive_batch) {
+				update_batch_size();
+			}
+
+			// Tune the checkpointing period of bound LPs on what happened in the last GVT phase
+			if(rootsim_config.checkpointing == AUTONOMIC_STATE_SAVING) {
+				autonomic_checkpoint_period();
+			}
+
 			my_phase = phase_end;
 
 			return last_gvt;
@@ -309,11 +664,17 @@ simtime_t gvt_operations(void) {
 		// new phase.
 		if(my_phase == phase_end) {
 
+			// Every thread has adopted the new GVT: this is the right
+			// time to migrate LPs across worker threads, if required
+			if(n_cores > 1 && rootsim_config.lp_rebalance_cycles > 0 && my_GVT_round % rootsim_config.lp_rebalance_cycles == 0) {
+				rebalance_LPs();
+			}
+
 			// Back to phase A for next GVT round
 			my_phase = phase_A;
-			local_min[tid] = INFTY;
-			local_min_barrier[tid] = INFTY;
-			atomic_dec(&counter_end);
+			local_min[gvt_slot()] = INFTY;
+			local_min_barrier[gvt_slot()] = INFTY;
+			atomic_dec(&gvt_shared->counter_end);
 			last_gvt = adopted_last_gvt;
 		}
 	}
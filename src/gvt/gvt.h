@@ -35,13 +35,21 @@
 #include <ROOT-Sim.h>
 #include <mm/state.h>
 
+/// GVT reduction in phases, with LPs visited twice per round
+#define GVT_PHASES		0
+
+/// Single-pass GVT reduction, on incrementally maintained local minima
+#define GVT_SINGLE_PASS		1
+
 /* API from gvt.c */
 extern void gvt_init(void);
 extern void gvt_fini(void);
 extern simtime_t gvt_operations(void);
+extern void gvt_message_sent(simtime_t timestamp);
 inline extern simtime_t get_last_gvt(void);
 
 /* API from fossil.c */
 extern void adopt_new_gvt(simtime_t, simtime_t);
+extern void fossil_collection_step(void);
 
 #endif
@@ -7,6 +7,9 @@
 
 unsigned int FindReceiver(int topology) {
 
+	// The topology is defined over global ids
+	unsigned int me = LidToGid(current_lp);
+
 	// receiver is not unsigned, because we exploit -1 as a border case in the bidring topology.
 	int receiver;
  	double u;
@@ -30,8 +33,8 @@ unsigned int FindReceiver(int topology) {
 
 			// Convert linear coords to hexagonal coords
 			edge = sqrt(n_prc_tot);
-			x = current_lp % edge;
-			y = current_lp / edge;
+			x = me % edge;
+			y = me / edge;
 
 			// Sanity check!
 			if(edge * edge != n_prc_tot) {
@@ -41,7 +44,7 @@ unsigned int FindReceiver(int topology) {
 
 			// Very simple case!
 			if(n_prc_tot == 1) {
-				receiver = current_lp;
+				receiver = me;
 				break;
 			}
 
@@ -111,8 +114,8 @@ unsigned int FindReceiver(int topology) {
 
 			// Convert linear coords to square coords
 			edge = sqrt(n_prc_tot);
-			x = current_lp % edge;
-			y = current_lp / edge;
+			x = me % edge;
+			y = me / edge;
 
 			// Sanity check!
 			if(edge * edge != n_prc_tot) {
@@ -123,7 +126,7 @@ unsigned int FindReceiver(int topology) {
 
 			// Very simple case!
 			if(n_prc_tot == 1) {
-				receiver = current_lp;
+				receiver = me;
 				break;
 			}
 
@@ -183,9 +186,9 @@ unsigned int FindReceiver(int topology) {
 			u = Random();
 
 			if (u < 0.5) {
-				receiver = current_lp - 1;
+				receiver = me - 1;
 			} else {
-				receiver= current_lp + 1;
+				receiver= me + 1;
 			}
 
    			if (receiver == -1) {
@@ -203,7 +206,7 @@ unsigned int FindReceiver(int topology) {
 
 		case TOPOLOGY_RING:
 
-			receiver= current_lp + 1;
+			receiver= me + 1;
 
 			if ((unsigned int)receiver == n_prc_tot) {
 				receiver = 0;
@@ -214,7 +217,7 @@ unsigned int FindReceiver(int topology) {
 
 		case TOPOLOGY_STAR:
 
-			if (current_lp == 0) {
+			if (me == 0) {
 				receiver = (int)(n_prc_tot * Random());
 			} else {
 				receiver = 0;
@@ -40,6 +40,7 @@
 #include <scheduler/scheduler.h>
 #include <scheduler/process.h>
 #include <mm/dymelor.h>
+#include <mm/numa.h>
 #include <mm/modules/ktblmgr/ktblmgr.h>
 #include <serial/serial.h>
 
@@ -87,10 +88,23 @@ static void *main_simulation_loop(void *arg) {
 
 	simtime_t my_time_barrier = -1.0;
 
+	// Pin the thread before it allocates anything
+	numa_bind_thread();
+
 	#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
 	lp_alloc_thread_init();
 	#endif
 
+	// Create the LPs-thread binding: each thread initializes its own LPs, in parallel
+	rebind_LPs();
+
+	// No message can be sent before all LPs of this kernel are initialized
+	thread_barrier(&all_thread_barrier);
+
+	if(master_thread()) {
+		SystemStart();
+	}
+
 	// Worker Threads synchronization barrier: they all should start working together
 	thread_barrier(&all_thread_barrier);
 
@@ -101,7 +115,7 @@ static void *main_simulation_loop(void *arg) {
 
 		// Check whether we have new ingoing messages sent by remote instances
 		// and then process bottom halves
-//		messages_checking();
+		messages_checking();
 		process_bottom_halves();
 
 		// Activate one LP and process one event. Send messages produced during the events' execution
@@ -109,6 +123,9 @@ static void *main_simulation_loop(void *arg) {
 
 		my_time_barrier = gvt_operations();
 
+		// Reclaim the memory of a few LPs, up to the last time barrier
+		fossil_collection_step();
+
 		// Only a master thread on master kernel prints the time barrier
 		if (master_kernel() && master_thread () && D_DIFFER(my_time_barrier, -1.0)) {
 			if (rootsim_config.verbose == VERBOSE_INFO || rootsim_config.verbose == VERBOSE_DEBUG) {
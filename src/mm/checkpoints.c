@@ -39,6 +39,108 @@
 #include <statistics/statistics.h>
 
 
+/// Number of incremental logs taken by each LP since its last full log
+static int *inc_logs;
+
+
+/// Header prepended to checkpoint buffers, telling which pool they must be returned to
+struct ckpt_header {
+	struct ckpt_header *next;	/// Next free buffer in the pool
+	unsigned int cls;		/// Size class of the buffer, or CKPT_NO_CLASS if it is not pooled
+} __attribute__((aligned(16)));
+
+/// Per-thread pool of free checkpoint buffers of one size class
+struct ckpt_pool {
+	struct ckpt_header *free;
+	unsigned int count;
+};
+
+/// Free checkpoint buffers, bucketed by size class. Buffers of a migrated LP are released to the pools of its new thread
+static __thread struct ckpt_pool ckpt_pools[CKPT_MAX_CLASS - CKPT_MIN_CLASS + 1];
+
+
+
+/**
+* This function returns a buffer which can hold a checkpoint of the given size. Since the state
+* size of a LP is quite stable, buffers are recycled from per-thread pools organized by power-of-two
+* size classes, rather than asking the allocator for a new buffer for every log.
+*
+* @param size The size of the checkpoint
+* @return A pointer to the buffer
+*/
+static void *ckpt_alloc(size_t size) {
+	struct ckpt_header *buff;
+	unsigned int cls = CKPT_MIN_CLASS;
+
+	while(cls <= CKPT_MAX_CLASS && ((size_t)1 << cls) < size)
+		cls++;
+
+	if(cls > CKPT_MAX_CLASS) {
+		buff = rsalloc(sizeof(struct ckpt_header) + size);
+		buff->cls = CKPT_NO_CLASS;
+		return buff + 1;
+	}
+
+	buff = ckpt_pools[cls - CKPT_MIN_CLASS].free;
+	if(buff != NULL) {
+		ckpt_pools[cls - CKPT_MIN_CLASS].free = buff->next;
+		ckpt_pools[cls - CKPT_MIN_CLASS].count--;
+	} else {
+		buff = rsalloc(sizeof(struct ckpt_header) + ((size_t)1 << cls));
+		buff->cls = cls;
+	}
+
+	return buff + 1;
+}
+
+
+
+/**
+* This function gives back to the calling thread's pools a buffer obtained from ckpt_alloc().
+* Pools are bounded, so exceeding buffers are released to the allocator.
+*
+* @param ckpt The buffer to release
+*/
+static void ckpt_free(void *ckpt) {
+	struct ckpt_header *buff = (struct ckpt_header *)ckpt - 1;
+	struct ckpt_pool *pool;
+
+	if(buff->cls == CKPT_NO_CLASS) {
+		rsfree(buff);
+		return;
+	}
+
+	pool = &ckpt_pools[buff->cls - CKPT_MIN_CLASS];
+	if(pool->count >= CKPT_POOL_DEPTH) {
+		rsfree(buff);
+		return;
+	}
+
+	buff->next = pool->free;
+	pool->free = buff;
+	pool->count++;
+}
+
+
+
+/**
+* This function initializes the per-LP checkpointing metadata
+*/
+void checkpoints_init(void) {
+	inc_logs = rsalloc(sizeof(int) * n_prc);
+	bzero(inc_logs, sizeof(int) * n_prc);
+}
+
+
+
+/**
+* This function finalizes the per-LP checkpointing metadata
+*/
+void checkpoints_fini(void) {
+	rsfree(inc_logs);
+}
+
+
 /**
 * This function creates a full log of the current simulation states and returns a pointer to it.
 * The algorithm behind this function is based on packing of the really allocated memory chunks into
@@ -85,8 +187,8 @@ void *log_full(int lid) {
 
 	size = sizeof(malloc_state)  + sizeof(seed_type) + m_state[lid]->busy_areas * sizeof(malloc_area) + m_state[lid]->bitmap_size + m_state[lid]->total_log_size;
 
-	// This code is in a malloc-wrapper package, so here we call the real malloc
-	ckpt = rsalloc(size);
+	// This code is in a malloc-wrapper package, so here we do not call malloc
+	ckpt = ckpt_alloc(size);
 
 	if(ckpt == NULL)
 		rootsim_error(true, "(%d) Unable to acquire memory for ckptging the current state (memory exhausted?)");
@@ -198,6 +300,152 @@ void *log_full(int lid) {
 
 
 
+/**
+* This function creates an incremental log of the current simulation state, namely a log
+* containing only the malloc_areas which changed since the last log, and for each of them
+* only the chunks which have been dirtied. The malloc_area metadata and the use bitmap are
+* always logged, so that the allocation layout can be rebuilt; the dirty bitmap tells which
+* chunks follow. The log is meaningful only on top of the chain of logs which precedes it,
+* up to the last full log.
+*
+* For further information, please see the paper:
+* 	A. Pellegrini, R. Vitali, F. Quaglia
+* 	Di-DyMeLoR: Logging only Dirty Chunks for Efficient Management of Dynamic Memory Based
+* 	Optimistic Simulation Objects
+*	Proceedings of the 23rd Workshop on Principles of Advanced and Distributed Simulation
+*	2009
+*
+* @param lid The logical process' local identifier
+* @return A pointer to a malloc()'d memory area which contains the incremental log of the current
+*         simulation state, along with the relative meta-data.
+*/
+void *log_incremental(int lid) {
+
+	void *ptr, *ckpt;
+	int i, j, k, idx, bitmap_blocks, dirty_areas;
+	size_t size, chunk_size, bitmaps_size, chunks_size;
+	malloc_area *m_area;
+
+	// Timers for self-tuning of the simulation platform
+	timer checkpoint_timer;
+	timer_start(checkpoint_timer);
+
+	// Compute the exact size of the log
+	dirty_areas = 0;
+	bitmaps_size = 0;
+	chunks_size = 0;
+	for(i = 0; i < m_state[lid]->num_areas; i++) {
+		m_area = &m_state[lid]->areas[i];
+
+		if(!m_area->state_changed || m_area->use_bitmap == NULL)
+			continue;
+
+		bitmap_blocks = m_area->num_chunks / NUM_CHUNKS_PER_BLOCK;
+		if (bitmap_blocks < 1)
+			bitmap_blocks = 1;
+
+		chunk_size = m_area->chunk_size;
+		RESET_BIT_AT(chunk_size, 0);
+		RESET_BIT_AT(chunk_size, 1);
+
+		dirty_areas++;
+		bitmaps_size += bitmap_blocks * BLOCK_SIZE;
+		if(m_area->dirty_chunks > 0) {
+			bitmaps_size += bitmap_blocks * BLOCK_SIZE;
+			chunks_size += m_area->dirty_chunks * chunk_size;
+		}
+	}
+
+	size = sizeof(malloc_state) + sizeof(seed_type) + dirty_areas * sizeof(malloc_area) + bitmaps_size + chunks_size;
+
+	ckpt = ckpt_alloc(size);
+
+	if(ckpt == NULL)
+		rootsim_error(true, "(%d) Unable to acquire memory for ckptging the current state (memory exhausted?)");
+
+	ptr = ckpt;
+
+	// Copy malloc_state in the ckpt
+	memcpy(ptr, m_state[lid], sizeof(malloc_state));
+	ptr = (void *)((char *)ptr + sizeof(malloc_state));
+	((malloc_state*)ckpt)->timestamp = current_lvt;
+	((malloc_state*)ckpt)->is_incremental = 1;
+	((malloc_state*)ckpt)->dirty_areas = dirty_areas;
+	((malloc_state*)ckpt)->dirty_bitmap_size = bitmaps_size;
+	((malloc_state*)ckpt)->total_inc_size = chunks_size;
+
+	// Copy the per-LP Seed State (to make the numerical library rollbackable and PWD)
+	memcpy(ptr, &LPS[lid]->seed, sizeof(seed_type));
+	ptr = (void *)((char *)ptr + sizeof(seed_type));
+
+	for(i = 0; i < m_state[lid]->num_areas; i++) {
+
+		m_area = &m_state[lid]->areas[i];
+
+		if(!m_area->state_changed || m_area->use_bitmap == NULL)
+			continue;
+
+		bitmap_blocks = m_area->num_chunks / NUM_CHUNKS_PER_BLOCK;
+		if (bitmap_blocks < 1)
+			bitmap_blocks = 1;
+
+		// Copy malloc_area and the use bitmap into the ckpt
+		memcpy(ptr, m_area, sizeof(malloc_area));
+		ptr = (void*)((char*)ptr + sizeof(malloc_area));
+
+		memcpy(ptr, m_area->use_bitmap, bitmap_blocks * BLOCK_SIZE);
+		ptr = (void*)((char*)ptr + bitmap_blocks * BLOCK_SIZE);
+
+		if(m_area->dirty_chunks > 0) {
+
+			// Copy the dirty bitmap, which tells which chunks follow
+			memcpy(ptr, m_area->dirty_bitmap, bitmap_blocks * BLOCK_SIZE);
+			ptr = (void*)((char*)ptr + bitmap_blocks * BLOCK_SIZE);
+
+			chunk_size = m_area->chunk_size;
+			RESET_BIT_AT(chunk_size, 0);	// ckpt Mode bit
+			RESET_BIT_AT(chunk_size, 1);	// Lock bit
+
+			for(j = 0; j < bitmap_blocks; j++) {
+
+				// Check the dirty bitmap on a per-block basis, to enhance scan speed
+				if(m_area->dirty_bitmap[j] == 0)
+					continue;
+
+				for(k = 0; k < NUM_CHUNKS_PER_BLOCK; k++) {
+					if(CHECK_BIT_AT(m_area->dirty_bitmap[j], k)) {
+						idx = j * NUM_CHUNKS_PER_BLOCK + k;
+						memcpy(ptr, (void*)((char*)m_area->area + (idx * chunk_size)), chunk_size);
+						ptr = (void*)((char*)ptr + chunk_size);
+					}
+				}
+			}
+		}
+
+		// Reset Dirty Bitmap, as the changes are in the ckpt chain now
+		m_area->dirty_chunks = 0;
+		m_area->state_changed = 0;
+		bzero((void *)m_area->dirty_bitmap, bitmap_blocks * BLOCK_SIZE);
+	}
+
+	// Sanity check
+	if ((char *)ckpt + size != ptr){
+		rootsim_error(false, "Actual (incremental) ckpt size different from the estimated one! ckpt = %p size = %x (%d), ptr = %p\n", ckpt, size, size, ptr);
+	}
+
+	m_state[lid]->dirty_areas = 0;
+	m_state[lid]->dirty_bitmap_size = 0;
+	m_state[lid]->total_inc_size = 0;
+
+	int checkpoint_time = timer_value_micro(checkpoint_timer);
+	statistics_post_lp_data(lid, STAT_CKPT_TIME, (double)checkpoint_time);
+	statistics_post_lp_data(lid, STAT_CKPT_MEM, (double)size);
+
+	return ckpt;
+}
+
+
+
 /**
 * This function is the only log function which should be called from the simulation platform. Actually,
 * it is a demultiplexer which calls the correct function depending on the current configuration of the
@@ -217,8 +465,30 @@ void *log_full(int lid) {
 *         along with the relative meta-data which can be used to perform a restore operation.
 */
 void *log_state(int lid) {
+	void *ckpt;
+
 	statistics_post_lp_data(lid, STAT_CKPT, 1.0);
-	return log_full(lid);
+
+	if(rootsim_config.snapshot != INC_SNAPSHOT || force_full[lid] == FORCE_FULL) {
+		ckpt = log_full(lid);
+
+	// A full log is taken when explicitly requested, every INCREMENTAL_GRANULARITY logs,
+	// or when most of the state is dirty, so that an incremental log would be as expensive
+	} else if(force_full[lid] == FORCE_FULL_NEXT || inc_logs[lid] >= INCREMENTAL_GRANULARITY ||
+	   m_state[lid]->total_inc_size >= m_state[lid]->total_log_size) {
+		force_full[lid] = NO_FORCE_FULL;
+		inc_logs[lid] = 0;
+		ckpt = log_full(lid);
+
+	} else {
+		inc_logs[lid]++;
+		ckpt = log_incremental(lid);
+	}
+
+	// Start tracking the writes which will be part of the next incremental log
+	protect_state(lid);
+
+	return ckpt;
 }
 
 
@@ -406,6 +676,109 @@ void restore_full(int lid, void *ckpt) {
 
 
 
+/**
+* This function applies an incremental log on top of the current simulation state, which
+* must be the one described by the previous log in the chain. Only the malloc_areas
+* recorded in the log are touched: their metadata and use bitmaps are restored, and the
+* logged dirty chunks are copied back in place.
+*
+* @param lid The logical process' local identifier
+* @param ckpt A pointer to the incremental log to apply
+*/
+void restore_incremental(int lid, void *ckpt) {
+
+	void *ptr;
+	int i, j, k, idx, bitmap_blocks, num_areas, logged_areas;
+	unsigned int *dirty_bitmap;
+	size_t chunk_size;
+	malloc_area *areas, *m_area, *logged_area;
+	unsigned int *use_bitmap, *curr_dirty_bitmap;
+	void *area;
+
+	// Timers for simulation platform self-tuning
+	timer recovery_timer;
+	timer_start(recovery_timer);
+	ptr = ckpt;
+	areas = m_state[lid]->areas;
+	num_areas = m_state[lid]->num_areas;
+
+	// Restore malloc_state, keeping the areas which were created afterwards
+	memcpy(m_state[lid], ptr, sizeof(malloc_state));
+	ptr = (void*)((char*)ptr + sizeof(malloc_state));
+	m_state[lid]->areas = areas;
+	if(num_areas > m_state[lid]->num_areas)
+		m_state[lid]->num_areas = num_areas;
+	logged_areas = ((malloc_state *)ckpt)->dirty_areas;
+
+	// Restore the per-LP Seed State (to make the numerical library rollbackable and PWD)
+	memcpy(&LPS[lid]->seed, ptr, sizeof(seed_type));
+	ptr = (void *)((char *)ptr + sizeof(seed_type));
+
+	for(i = 0; i < logged_areas; i++) {
+
+		logged_area = (malloc_area *)ptr;
+		ptr = (void*)((char*)ptr + sizeof(malloc_area));
+		m_area = &areas[logged_area->idx];
+
+		// Restore the malloc_area, but keep the current buffers
+		use_bitmap = m_area->use_bitmap;
+		curr_dirty_bitmap = m_area->dirty_bitmap;
+		area = m_area->area;
+		memcpy(m_area, logged_area, sizeof(malloc_area));
+		m_area->use_bitmap = use_bitmap;
+		m_area->dirty_bitmap = curr_dirty_bitmap;
+		m_area->area = area;
+
+		bitmap_blocks = m_area->num_chunks / NUM_CHUNKS_PER_BLOCK;
+		if(bitmap_blocks < 1)
+			bitmap_blocks = 1;
+
+		// Restore use bitmap
+		memcpy(m_area->use_bitmap, ptr, bitmap_blocks * BLOCK_SIZE);
+		ptr = (void*)((char*)ptr + bitmap_blocks * BLOCK_SIZE);
+
+		if(logged_area->dirty_chunks > 0) {
+
+			dirty_bitmap = (unsigned int *)ptr;
+			ptr = (void*)((char*)ptr + bitmap_blocks * BLOCK_SIZE);
+
+			chunk_size = m_area->chunk_size;
+			RESET_BIT_AT(chunk_size, 0);
+			RESET_BIT_AT(chunk_size, 1);
+
+			for(j = 0; j < bitmap_blocks; j++) {
+
+				if(dirty_bitmap[j] == 0)
+					continue;
+
+				for(k = 0; k < NUM_CHUNKS_PER_BLOCK; k++) {
+					if(CHECK_BIT_AT(dirty_bitmap[j], k)) {
+						idx = j * NUM_CHUNKS_PER_BLOCK + k;
+						memcpy((void*)((char*)m_area->area + (idx * chunk_size)), ptr, chunk_size);
+						ptr = (void*)((char*)ptr + chunk_size);
+					}
+				}
+			}
+		}
+
+		// Reset dirty bitmap
+		bzero(m_area->dirty_bitmap, bitmap_blocks * BLOCK_SIZE);
+		m_area->dirty_chunks = 0;
+		m_area->state_changed = 0;
+	}
+
+	m_state[lid]->timestamp = -1;
+	m_state[lid]->is_incremental = -1;
+	m_state[lid]->dirty_areas = 0;
+	m_state[lid]->dirty_bitmap_size = 0;
+	m_state[lid]->total_inc_size = 0;
+
+	int recovery_time = timer_value_micro(recovery_timer);
+	statistics_post_lp_data(lid, STAT_RECOVERY_TIME, (double)recovery_time);
+}
+
+
+
 /**
 * Upon the decision of performing a rollback operation, this function is invoked by the simulation
 * kernel to perform a restore operation.
@@ -419,25 +792,126 @@ void restore_full(int lid, void *ckpt) {
 * @param queue_node a pointer to the simulation state which must be restored in the logical process
 */
 void log_restore(int lid, state_t *state_queue_node) {
+	state_t *s;
+
 	statistics_post_lp_data(lid, STAT_RECOVERY, 1.0);
-	restore_full(lid, state_queue_node->log);
+
+	// The whole state is going to be rewritten: there is no point in tracking these writes
+	unprotect_state(lid);
+
+	if(!is_incremental(state_queue_node->log)) {
+		restore_full(lid, state_queue_node->log);
+		protect_state(lid);
+		return;
+	}
+
+	// Walk back to the last full log, and then apply all the incremental logs up to the requested one
+	s = state_queue_node;
+	while(s != NULL && is_incremental(s->log))
+		s = list_prev(s);
+
+	if(s == NULL)
+		rootsim_error(true, "LP %d: no full log is available to restore an incremental log at time %f\n", lid, state_queue_node->lvt);
+
+	restore_full(lid, s->log);
+	do {
+		s = list_next(s);
+		restore_incremental(lid, s->log);
+	} while(s != state_queue_node);
+
+	protect_state(lid);
+}
+
+
+
+/**
+* This function finds where a full log keeps the content that a byte of the LP's memory
+* had when the log was taken. Nothing is restored: the returned pointer gives read-only
+* access to the logged version of the chunk holding that byte, while any pointer stored
+* in the chunk still refers to the live memory of the LP.
+*
+* @param ckpt A pointer to the log
+* @param ptr An address in the memory of the LP which took the log
+* @return The address of the logged copy of ptr, or NULL if the log is incremental
+* 	   or the chunk holding ptr was not allocated when the log was taken
+*/
+void *log_lookup(void *ckpt, void *ptr) {
+	malloc_state *logged_state = (malloc_state *)ckpt;
+	malloc_area *m_area;
+	unsigned int *use_bitmap;
+	char *log_ptr;
+	int i, j, idx, bitmap_blocks, preceding;
+	size_t chunk_size, offset;
+
+	if(ckpt == NULL || is_incremental(ckpt)) {
+		return NULL;
+	}
+
+	log_ptr = (char *)ckpt + sizeof(malloc_state) + sizeof(seed_type);
+
+	// Logged areas are laid out one after the other, as in log_full()
+	for(i = 0; i < logged_state->busy_areas; i++) {
+
+		m_area = (malloc_area *)log_ptr;
+		log_ptr += sizeof(malloc_area);
+
+		bitmap_blocks = m_area->num_chunks / NUM_CHUNKS_PER_BLOCK;
+		if(bitmap_blocks < 1)
+			bitmap_blocks = 1;
+
+		use_bitmap = (unsigned int *)log_ptr;
+		log_ptr += bitmap_blocks * BLOCK_SIZE;
+
+		chunk_size = m_area->chunk_size;
+		RESET_BIT_AT(chunk_size, 0);	// ckpt Mode bit
+		RESET_BIT_AT(chunk_size, 1);	// Lock bit
+
+		if((char *)ptr < (char *)m_area->area || (char *)ptr >= (char *)m_area->area + m_area->num_chunks * chunk_size) {
+			log_ptr += (CHECK_LOG_MODE_BIT(m_area) ? m_area->num_chunks : m_area->alloc_chunks) * chunk_size;
+			continue;
+		}
+
+		idx = (int)(((char *)ptr - (char *)m_area->area) / chunk_size);
+		offset = ((char *)ptr - (char *)m_area->area) % chunk_size;
+
+		// The area has been entirely logged
+		if(CHECK_LOG_MODE_BIT(m_area)) {
+			return log_ptr + idx * chunk_size + offset;
+		}
+
+		// Only the allocated chunks have been logged, in the order of the bitmap
+		if(!CHECK_BIT_AT(use_bitmap[idx / NUM_CHUNKS_PER_BLOCK], idx % NUM_CHUNKS_PER_BLOCK)) {
+			return NULL;
+		}
+
+		preceding = 0;
+		for(j = 0; j < idx / NUM_CHUNKS_PER_BLOCK; j++) {
+			preceding += __builtin_popcount(use_bitmap[j]);
+		}
+		preceding += __builtin_popcount(use_bitmap[idx / NUM_CHUNKS_PER_BLOCK] & ((1U << (idx % NUM_CHUNKS_PER_BLOCK)) - 1));
+
+		return log_ptr + preceding * chunk_size + offset;
+	}
+
+	return NULL;
 }
 
 
 
 /**
 * This function is called directly from the simulation platform kernel to delete a certain log
-* during the fossil collection.
+* during the fossil collection, or when pruning logs upon a rollback. The buffer is recycled
+* for the next logs.
 *
 * @author Alessandro Pellegrini
 * @author Roberto Vitali
 *
-* @param queue_node a pointer to the simulation state which must be restored in the logical process
+* @param ckpt a pointer to the log to delete
 *
 */
 void log_delete(void *ckpt){
-	if(log != NULL) {
-		rsfree(ckpt);
+	if(ckpt != NULL) {
+		ckpt_free(ckpt);
 	}
 }
 
@@ -38,7 +38,7 @@
 
 
 /// Current per-logical process state
-malloc_state *m_state[MAX_LPs];
+malloc_state **m_state;
 
 
 
@@ -56,7 +56,36 @@ __thread cache_line cache_chunk_address[CACHE_SIZE]; // __attribute__ ((section
 
 
 /// Flag to tell DyMeLoR to take a full log upon next invocation of log_state, independently of any other configuration/current state
-int force_full[MAX_LPs];
+int *force_full;
+
+
+/// Chunks of a malloc_area, as seen by the write-protection based tracking of dirty memory
+struct tracked_area {
+	/// Boundaries of the chunks of the malloc_area (start == NULL if the area has no memory)
+	char *start;
+	char *end;
+	/// Span of the chunks made writable since the last call to protect_state() (first_written == NULL if none)
+	char *first_written;
+	char *last_written;
+};
+
+
+/// Per-LP metadata of the write-protection based tracking of dirty memory. It is not part of the malloc_state, so it is neither logged nor restored
+struct write_tracking {
+	/// Tracked areas, indexed by the idx of the malloc_area
+	struct tracked_area *areas;
+	/// Number of entries available in areas, sorted and written
+	int max_areas;
+	/// Indices of the areas which have memory, sorted by address, to find the area hit by a write fault
+	int *sorted;
+	int num_sorted;
+	/// Indices of the areas which have been made writable since the last call to protect_state()
+	int *written;
+	int num_written;
+};
+
+/// Write tracking metadata of each LP (NULL if plain stores are not tracked)
+static struct write_tracking **tracking;
 
 
 /// This global variable counts the number of write access to memory for the statistic needed by the autonic layer
@@ -73,6 +102,7 @@ static void load_cache_line(void *, void *, unsigned int);
 static malloc_area *get_area(void *);
 static size_t compute_size(size_t);
 static void find_next_free(malloc_area*);
+static void mark_dirty_chunks(unsigned int, malloc_area *, int, int);
 
 
 /**
@@ -84,25 +114,44 @@ static void find_next_free(malloc_area*);
 */
 void dymelor_init(void) {
 
-	register unsigned int i;
-
 	// Preallocate memory for the LPs
 	lp_alloc_init();
 
-	for(i = 0; i < n_prc; i++){
+	// Per-LP malloc states are created by dymelor_init_LP()
+	m_state = rsalloc(sizeof(malloc_state *) * n_prc);
+	force_full = rsalloc(sizeof(int) * n_prc);
+	tracking = NULL;
+	if(tracking_writes()) {
+		tracking = rsalloc(sizeof(struct write_tracking *) * n_prc);
+	}
+	checkpoints_init();
+}
+
+
 
-//		m_state[i] = (malloc_state*)__real_malloc(sizeof(malloc_state));
-		m_state[i] = (malloc_state*)rsalloc(sizeof(malloc_state));
-		if(m_state[i] == NULL)
-			rootsim_error(true, "Unable to allocate memory on malloc init");
+/**
+* This function inizializes the dymelor metadata of a LP. It is called by
+* the worker thread hosting the LP, when the LP is initialized.
+*
+* @param lid The local id of the LP
+*/
+void dymelor_init_LP(unsigned int lid) {
 
-		malloc_state_init(m_state[i]);
+//	m_state[lid] = (malloc_state*)__real_malloc(sizeof(malloc_state));
+	m_state[lid] = (malloc_state*)rsalloc(sizeof(malloc_state));
+	if(m_state[lid] == NULL)
+		rootsim_error(true, "Unable to allocate memory on malloc init");
 
-		// Next (first) log must be taken, and taken full!
-		force_LP_checkpoint(i);
-		force_full[i] = FORCE_FULL_NEXT;
+	malloc_state_init(m_state[lid]);
+
+	if(tracking_writes()) {
+		tracking[lid] = rsalloc(sizeof(struct write_tracking));
+		bzero(tracking[lid], sizeof(struct write_tracking));
 	}
 
+	// Next (first) log must be taken, and taken full!
+	force_LP_checkpoint(lid);
+	force_full[lid] = FORCE_FULL_NEXT;
 }
 
 
@@ -134,11 +183,15 @@ void dymelor_fini(void){
 	// Release as well memory used for remaining logs
 	for(i = 0; i < n_prc; i++) {
 		while(!list_empty(LPS[i]->queue_states)) {
-			rsfree(list_head(LPS[i]->queue_states)->log);
+			log_delete(list_head(LPS[i]->queue_states)->log);
 			list_pop(LPS[i]->queue_states);
 		}
 	}
 
+	checkpoints_fini();
+	rsfree(force_full);
+	rsfree(m_state);
+
 	lp_alloc_fini();
 }
 
@@ -249,6 +302,53 @@ void set_force_full(unsigned int lid, int value){
 }
 
 
+/**
+* This function sets the dirty bit of a range of chunks of a malloc_area belonging to
+* a LP, keeping the size estimation of the next incremental log up to date.
+*
+* @param lid The local id of the LP owning the malloc_area
+* @param m_area The malloc_area containing the chunks
+* @param first_chunk The index of the first chunk to mark
+* @param last_chunk The index of the last chunk to mark (included)
+*/
+static void mark_dirty_chunks(unsigned int lid, malloc_area *m_area, int first_chunk, int last_chunk) {
+	int i, bitmap_blocks;
+	size_t chk_size;
+
+	chk_size = m_area->chunk_size;
+	RESET_BIT_AT(chk_size, 0);
+	RESET_BIT_AT(chk_size, 1);
+
+	bitmap_blocks = m_area->num_chunks / NUM_CHUNKS_PER_BLOCK;
+	if(bitmap_blocks < 1)
+		bitmap_blocks = 1;
+
+	// The dirty bitmap is logged only if there is at least one dirty chunk
+	if (m_area->state_changed == 1){
+		if (m_area->dirty_chunks == 0)
+			m_state[lid]->dirty_bitmap_size += bitmap_blocks * BLOCK_SIZE;
+	} else {
+		m_state[lid]->dirty_areas++;
+		m_state[lid]->dirty_bitmap_size += bitmap_blocks * BLOCK_SIZE * 2;
+		m_area->state_changed = 1;
+	}
+
+	for(i = first_chunk; i <= last_chunk; i++){
+
+		// If it is dirted a clean chunk, set it dirty and increase dirty object count for the malloc_area
+		if (!CHECK_DIRTY_BIT(m_area, i)){
+			SET_DIRTY_BIT(m_area, i);
+			m_state[lid]->total_inc_size += chk_size;
+			m_area->dirty_chunks++;
+		}
+	}
+
+	if(lid == current_lp)
+		m_area->last_access = current_lvt;
+}
+
+
+
 /**
 * This function marks a memory chunk as dirty.
 * It is invoked from assembly modules invoked by calls injected by the instrumentor, and from the
@@ -263,79 +363,263 @@ void set_force_full(unsigned int lid, int value){
 */
 void dirty_mem(void *base, int size) {
 
+	int 	first_chunk,
+		last_chunk;
+	size_t	chk_size;
+	malloc_area *m_area;
 
-	// TODO: Quando reintegriamo l'incrementale questo qui deve ricomparire!
-	(void)base;
-	(void)size;
+	// Dirty chunks are only relevant when incremental logs are taken, and only for LPs' memory
+	if(!tracking_writes() || current_lp == IDLE_PROCESS) {
+		return;
+	}
 
+	// Sanity check on passed address
+	if(base == NULL || size == 0) {
+		return;
+	}
 
-	return;
+	m_area = get_area(base);
+	if(m_area == NULL) {
+		return;
+	}
 
-#if 0
-//	unsigned long long current_cost;
+	chk_size = m_area->chunk_size;
+	RESET_BIT_AT(chk_size, 0);
+	RESET_BIT_AT(chk_size, 1);
 
-	// Sanity check on passed address
-/*	if(base == NULL) {
-		rootsim_error(false, "Trying to access NULL. Memory interception aborted\n");
+	// Compute the number of chunks affected by the write
+	first_chunk = (int)(((char *)base - (char *)m_area->area) / chk_size);
+
+	// If size == -1, then we adopt a conservative approach: dirty all the chunks from the base to the end
+	// of the actual malloc area base address belongs to.
+	// This has been inserted to support the wrapping of third-party libraries where the size of the
+	// update (or even the actual update) cannot be statically/dynamically determined.
+	if(size == -1)
+		last_chunk = m_area->num_chunks - 1;
+	else
+		last_chunk = (int)(((char *)base + size - 1 - (char *)m_area->area) / chk_size);
+
+	if(last_chunk >= m_area->num_chunks)
+		last_chunk = m_area->num_chunks - 1;
+
+	mark_dirty_chunks(current_lp, m_area, first_chunk, last_chunk);
+}
+
+
+
+/**
+* This function records that a portion of a tracked area has been made writable, so that
+* the next call to protect_state() write-protects it again.
+*
+* @param t The write tracking metadata of the LP
+* @param idx The idx of the malloc_area
+* @param first The initial address of the writable portion
+* @param last The final address (excluded) of the writable portion
+*/
+static void mark_written(struct write_tracking *t, int idx, char *first, char *last) {
+	struct tracked_area *area = &t->areas[idx];
+
+	if(area->first_written == NULL) {
+		t->written[t->num_written++] = idx;
+		area->first_written = first;
+		area->last_written = last;
 		return;
 	}
+
+	if(first < area->first_written)
+		area->first_written = first;
+	if(last > area->last_written)
+		area->last_written = last;
+}
+
+
+
+/**
+* This function starts tracking the writes to the chunks of a malloc_area which has just been
+* given its memory. The memory is writable, so it is recorded as written.
+*
+* @param lid The local id of the LP owning the malloc_area
+* @param idx The idx of the malloc_area
+* @param start The initial address of the chunks
+* @param size The size of the chunks of the malloc_area
 */
-/*	if (rootsim_config.snapshot == AUTONOMIC_SNAPSHOT ||
-	    rootsim_config.snapshot == AUTONOMIC_INC_SNAPSHOT ||
-	    rootsim_config.snapshot == AUTONOMIC_FULL_SNAPSHOT)
-		add_counter++;
+static void track_area(unsigned int lid, int idx, void *start, size_t size) {
+	struct write_tracking *t = tracking[lid];
+	int i, new_max;
+
+	// Grow the metadata, which is never done by the write fault handler
+	if(idx >= t->max_areas) {
+		new_max = t->max_areas == 0 ? MAX_NUM_AREAS : t->max_areas * 2;
+		while(new_max <= idx)
+			new_max *= 2;
+
+		t->areas = rsrealloc(t->areas, new_max * sizeof(struct tracked_area));
+		t->sorted = rsrealloc(t->sorted, new_max * sizeof(int));
+		t->written = rsrealloc(t->written, new_max * sizeof(int));
+		bzero(&t->areas[t->max_areas], (new_max - t->max_areas) * sizeof(struct tracked_area));
+		t->max_areas = new_max;
+	}
+
+	t->areas[idx].start = start;
+	t->areas[idx].end = (char *)start + size;
+
+	// Keep the areas sorted by address
+	for(i = t->num_sorted; i > 0 && t->areas[t->sorted[i - 1]].start > (char *)start; i--) {
+		t->sorted[i] = t->sorted[i - 1];
+	}
+	t->sorted[i] = idx;
+	t->num_sorted++;
+
+	mark_written(t, idx, t->areas[idx].start, t->areas[idx].end);
+}
+
+
+
+/**
+* This function stops tracking the writes to the chunks of a malloc_area whose memory is released.
+*
+* @param lid The local id of the LP owning the malloc_area
+* @param idx The idx of the malloc_area
 */
-	int 	first_chunk,
-		last_chunk,
-		i,
-		chk_size,
-		bitmap_blocks;
+static void untrack_area(unsigned int lid, int idx) {
+	struct write_tracking *t = tracking[lid];
+	int i;
 
-	malloc_area *m_area = get_area(base);
+	if(idx >= t->max_areas || t->areas[idx].start == NULL)
+		return;
 
-	if(m_area != NULL){
+	for(i = 0; t->sorted[i] != idx; i++);
+	for(; i < t->num_sorted - 1; i++) {
+		t->sorted[i] = t->sorted[i + 1];
+	}
+	t->num_sorted--;
 
-		chk_size = m_area->chunk_size;
-		RESET_BIT_AT(chk_size, 0);
-		RESET_BIT_AT(chk_size, 1);
+	// protect_state() skips the area, if it is still in the written list
+	t->areas[idx].start = NULL;
+	t->areas[idx].first_written = NULL;
+}
 
-		// Compute the number of chunks affected by the write
-		first_chunk = (int)(((char *)base - (char *)m_area->area) / chk_size);
 
-		// If size == -1, then we adopt a conservative approach: dirty all the chunks from the base to the end
-		// of the actual malloc area base address belongs to.
-		// This has been inserted to support the wrapping of third-party libraries where the size of the
-		// update (or even the actual update) cannot be statically/dynamically determined.
-		if(size == -1)
-			last_chunk = m_area->num_chunks - 1;
-		else
-			last_chunk = (int)(((char *)base + size - 1 - (char *)m_area->area) / chk_size);
-
-		bitmap_blocks = m_area->num_chunks / NUM_CHUNKS_PER_BLOCK;
-                if(bitmap_blocks < 1)
-                       bitmap_blocks = 1;
-
-		if (m_area->state_changed == 1){
-                        if (m_area->dirty_chunks == 0)
-                                m_state[current_lp]->dirty_bitmap_size += bitmap_blocks * BLOCK_SIZE;
-                } else {
-                        m_state[current_lp]->dirty_areas++;
-                        m_state[current_lp]->dirty_bitmap_size += bitmap_blocks * BLOCK_SIZE * 2;
-                        m_area->state_changed = 1;
-                }
-
-                for(i = first_chunk; i <= last_chunk; i++){
-
-                        // If it is dirted a clean chunk, set it dirty and increase dirty object count for the malloc_area
-                        if (!CHECK_DIRTY_BIT(m_area, i)){
-                                SET_DIRTY_BIT(m_area, i);
-                                m_state[current_lp]->total_inc_size += chk_size;
-
-                                m_area->dirty_chunks++;
-                        }
-                }
+
+/**
+* This function marks as dirty all the chunks of a LP which lie in a page.
+* It is invoked by the write-protection fault handler of the LP memory preallocator,
+* upon the first write to a page after the last log, so it must not rely on the chunk
+* cache, which is per-thread and bound to the current LP. The malloc_area is found with
+* a binary search on the tracked areas, and no memory is allocated.
+*
+* @param lid The local id of the LP owning the page
+* @param base The initial address of the page
+* @param size The size of the page
+*/
+void dirty_pages(unsigned int lid, void *base, size_t size) {
+	struct write_tracking *t = tracking[lid];
+	struct tracked_area *area;
+	int low, high, mid, idx, first_chunk, last_chunk;
+	size_t chk_size;
+	malloc_area *m_area;
+
+	// Find the last area starting at or before base
+	idx = -1;
+	low = 0;
+	high = t->num_sorted - 1;
+	while(low <= high) {
+		mid = (low + high) / 2;
+		if(t->areas[t->sorted[mid]].start <= (char *)base) {
+			idx = t->sorted[mid];
+			low = mid + 1;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	// Chunks of different areas never share a page, so the page belongs to at most one area
+	if(idx == -1 || (char *)base >= t->areas[idx].end)
+		return;
+
+	area = &t->areas[idx];
+	mark_written(t, idx, base, (char *)base + size);
+
+	m_area = &m_state[lid]->areas[idx];
+	chk_size = m_area->chunk_size;
+	RESET_BIT_AT(chk_size, 0);
+	RESET_BIT_AT(chk_size, 1);
+
+	first_chunk = (int)(((char *)base - area->start) / chk_size);
+
+	if((char *)base + size < area->end)
+		last_chunk = (int)(((char *)base + size - 1 - area->start) / chk_size);
+	else
+		last_chunk = m_area->num_chunks - 1;
+
+	mark_dirty_chunks(lid, m_area, first_chunk, last_chunk);
+}
+
+
+
+/**
+* This function write-protects the chunks of a LP which have been made writable since its
+* last call, so that the first write to each page after this call is reported to dirty_pages().
+* This is how plain stores of a non-instrumented model are tracked. It must be called right
+* after a log is taken or restored, when there are no dirty chunks.
+* Only the pages written since the last log (and the areas created since then) are protected
+* again, so the cost of this function does not depend on the size of the state.
+*
+* Note that, as long as they are protected, the pages of a LP cannot be written by the kernel
+* on behalf of the LP: system calls which store data into the LP's memory (e.g. read() into a
+* buffer allocated by the model) fail with EFAULT instead of raising a fault. Such buffers must
+* be written by the model in user space first.
+*
+* @param lid The local id of the LP
+*/
+void protect_state(unsigned int lid) {
+	struct write_tracking *t;
+	struct tracked_area *area;
+	int i;
+
+	if(!tracking_writes())
+		return;
+
+	t = tracking[lid];
+
+	for(i = 0; i < t->num_written; i++) {
+		area = &t->areas[t->written[i]];
+
+		if(area->first_written == NULL)
+			continue;
+
+		lp_protect(area->first_written, area->last_written - area->first_written, true);
+		area->first_written = NULL;
+	}
+
+	t->num_written = 0;
+}
+
+
+
+/**
+* This function removes the write protection from the chunks of all the malloc_areas of a LP.
+* It is used before the kernel rewrites the whole state (i.e., upon a restore), when tracking
+* writes is pointless.
+*
+* @param lid The local id of the LP
+*/
+void unprotect_state(unsigned int lid) {
+	struct write_tracking *t;
+	struct tracked_area *area;
+	int i;
+
+	if(!tracking_writes())
+		return;
+
+	t = tracking[lid];
+
+	for(i = 0; i < t->num_sorted; i++) {
+		area = &t->areas[t->sorted[i]];
+
+		lp_protect(area->start, area->end - area->start, false);
+		mark_written(t, t->sorted[i], area->start, area->end);
 	}
-#endif
 }
 
 
@@ -554,6 +838,7 @@ void *__wrap_malloc(size_t size) {
 
 	malloc_area *m_area, *prev_area;
 	void *ptr, *final_address;
+	char *raw_area;
 	int bitmap_blocks, num_chunks, malloc_area_idx;
 
 	int j;
@@ -581,6 +866,22 @@ void *__wrap_malloc(size_t size) {
 			m_area = &(m_state[current_lp]->areas[m_area->next]);
 	}
 
+	if(m_area == NULL){
+
+		// Reuse a malloc_area of the same chunk size whose buffers have been released at GVT, if any
+		for(j = NUM_AREAS; j < m_state[current_lp]->num_areas; j++) {
+			if(m_state[current_lp]->areas[j].use_bitmap == NULL && (m_state[current_lp]->areas[j].chunk_size & ~((size_t)3)) == size) {
+				m_area = &m_state[current_lp]->areas[j];
+
+				// The malloc area to be reused has twice the number of chunks wrt the last full malloc area for the same chunks size
+				malloc_area_init(m_area, size, prev_area->num_chunks << 1);
+				prev_area->next = m_area->idx;
+				m_area->prev = prev_area->idx;
+				break;
+			}
+		}
+	}
+
 	if(m_area == NULL){
 
 		if(m_state[current_lp]->num_areas == m_state[current_lp]->max_num_areas){
@@ -629,7 +930,19 @@ void *__wrap_malloc(size_t size) {
 			bitmap_blocks = 1;
 
 		// lp_malloc
-		m_area->use_bitmap = (unsigned int *)lp_malloc(bitmap_blocks * BLOCK_SIZE * 2 + num_chunks * size);
+		if(tracking_writes()) {
+			// Chunks are write-protected on a per-page basis: they must not share pages with
+			// other data, so the area starts on a page boundary and a trailing page is left free
+			raw_area = lp_malloc(bitmap_blocks * BLOCK_SIZE * 2 + num_chunks * size + 2 * TRACKING_PAGE_SIZE);
+			if(raw_area == NULL) {
+				m_area->use_bitmap = NULL;
+			} else {
+				raw_area = (char *)(((unsigned long)raw_area + bitmap_blocks * BLOCK_SIZE * 2 + TRACKING_PAGE_SIZE - 1) & ~((unsigned long)TRACKING_PAGE_SIZE - 1));
+				m_area->use_bitmap = (unsigned int *)(raw_area - bitmap_blocks * BLOCK_SIZE * 2);
+			}
+		} else {
+			m_area->use_bitmap = (unsigned int *)lp_malloc(bitmap_blocks * BLOCK_SIZE * 2 + num_chunks * size);
+		}
 
 		if(m_area->use_bitmap == NULL){
 			rootsim_error(true, "DyMeLoR: error allocating space for the use bitmap");
@@ -642,6 +955,10 @@ void *__wrap_malloc(size_t size) {
 		m_area->dirty_bitmap = (unsigned int*)((char*)m_area->use_bitmap + bitmap_blocks * BLOCK_SIZE);
 
 		m_area->area = (void*)((char*)m_area->use_bitmap + bitmap_blocks * BLOCK_SIZE * 2);
+
+		if(tracking_writes()) {
+			track_area(current_lp, m_area->idx, m_area->area, num_chunks * size);
+		}
 	}
 
 	if(m_area->area == NULL)
@@ -679,6 +996,11 @@ void *__wrap_malloc(size_t size) {
 			m_state[current_lp]->total_log_size += size;
 	}
 
+	// The content of a newly allocated chunk is not part of any previous log
+	if(rootsim_config.snapshot == INC_SNAPSHOT) {
+		mark_dirty_chunks(current_lp, m_area, m_area->next_chunk, m_area->next_chunk);
+	}
+
 	find_next_free(m_area);
 
 	int chk_size = m_area->chunk_size;
@@ -1068,7 +1390,7 @@ void clean_buffers_on_gvt(unsigned int lid, simtime_t time_barrier){
 
 	state = m_state[lid];
 
-	// The first NUM_AREAS malloc_areas are placed accordind to their chunks' sizes. The exceeding malloc_areas can be compacted
+	// The first NUM_AREAS malloc_areas are placed accordind to their chunks' sizes. The exceeding malloc_areas can be released
 	for(i = NUM_AREAS; i < state->num_areas; i++){
 		m_area = &state->areas[i];
 
@@ -1077,6 +1399,10 @@ void clean_buffers_on_gvt(unsigned int lid, simtime_t time_barrier){
 
 			if(m_area->use_bitmap != NULL) {
 
+				if(tracking_writes()) {
+					untrack_area(lid, i);
+				}
+
 				// lp_free
 				lp_free(m_area->use_bitmap);
 
@@ -1091,20 +1417,10 @@ void clean_buffers_on_gvt(unsigned int lid, simtime_t time_barrier){
 				if(m_area->next != -1)
 					state->areas[m_area->next].prev = m_area->prev;
 
-				// Swap, if possible
-				if(i < state->num_areas - 1) {
-					memcpy(m_area, &state->areas[state->num_areas - 1], sizeof(malloc_area));
-					m_area->idx = i;
-					if(m_area->prev != -1)
-						state->areas[m_area->prev].next = m_area->idx;
-					if(m_area->next != -1)
-						state->areas[m_area->next].prev = m_area->idx;
-					// The swapped area will now be checked
-					i--;
-				}
+				// The area is neither moved to fill the hole nor reused for a different
+				// chunk size: logs still in the chain refer to malloc_areas by their idx
+				// and link them in per-size lists, which must therefore stay valid
 
-				// Decrement the expected number of areas
-				state->num_areas--;
 				// Era has to be incremented
 				increment_era = 1;
 			}
@@ -78,6 +78,16 @@
 #define MAX_LOG_THRESHOLD 1.7	// Threshold to check if a malloc_area is underused TODO: retest
 #define MIN_LOG_THRESHOLD 1.7	// Threshold to check if a malloc_area is overused TODO: retest
 
+/// Checkpoint buffers are pooled in power-of-two size classes, from 2^CKPT_MIN_CLASS to 2^CKPT_MAX_CLASS bytes
+#define CKPT_MIN_CLASS		8
+#define CKPT_MAX_CLASS		20
+
+/// Size class of checkpoint buffers which are too large to be pooled
+#define CKPT_NO_CLASS		UINT_MAX
+
+/// Maximum number of free buffers kept by each thread for each size class
+#define CKPT_POOL_DEPTH		32
+
 
 #ifndef INCREMENTAL_GRANULARITY
  #define INCREMENTAL_GRANULARITY 50 // Number of incremental logs before a full log is forced
@@ -196,17 +206,29 @@ typedef struct _malloc_state malloc_state;
 
 
 /** This macro describes how much memory is pre-allocated for each LP.
-  * This sets each LP's maximum available memory (minus metadata).
-  * Changing this is non-trivial, as Linux has a limit on the size of an mmap call,
-  * so this must be reflected in the number of mmap calls in lp-alloc.c!
+  * This sets each LP's maximum available memory (minus metadata), unless there
+  * are so many LPs that they must share LP_PREALLOCATION_MAX_SPACE.
   */
 #define PER_LP_PREALLOCATED_MEMORY	512*512*4096 // Allow 1 GB of virtual space per LP
 
+/// Total virtual space which can be preallocated for all the LPs
+#define LP_PREALLOCATION_MAX_SPACE	(1ULL << 46) // 64 TB, half of the user space on x86-64
+
+/// Linux has a limit on the size of an mmap call: larger preallocations are split into this size
+#define LP_PREALLOCATION_MMAP_SIZE	((size_t)PER_LP_PREALLOCATED_MEMORY / 2)
+
 
 /// This macro tells the LP memory preallocator where to start preallocating. This must be a PDP entry-aligned value!
 #define LP_PREALLOCATION_INITIAL_ADDRESS	(void *)0x0000008000000000
 
 
+/// Granularity of the write-protection based tracking of dirty memory
+#define TRACKING_PAGE_SIZE	4096
+
+/// Plain stores to LPs' memory are tracked via write protection when incremental logs are taken
+#define tracking_writes()	(rootsim_config.snapshot == INC_SNAPSHOT && !rootsim_config.serial)
+
+
 /// This structure describes per-LP memory
 struct _lp_memory {
 	void *start;
@@ -229,8 +251,8 @@ struct _lp_memory {
 // TODO: quali sono realmente da esporre all'esterno?!
 
 extern int incremental_granularity;
-extern int force_full[MAX_LPs];
-extern malloc_state *m_state[MAX_LPs];
+extern int *force_full;
+extern malloc_state **m_state;
 extern double checkpoint_cost_per_byte;
 extern double recovery_cost_per_byte;
 extern unsigned long total_checkpoints;
@@ -241,9 +263,13 @@ extern double checkpoint_bytes_total;
 
 // DyMeLoR API
 extern void dymelor_init(void);
+extern void dymelor_init_LP(unsigned int);
 extern void dymelor_fini(void);
 extern void set_force_full(unsigned int, int);
 extern void dirty_mem(void *, int);
+extern void dirty_pages(unsigned int, void *, size_t);
+extern void protect_state(unsigned int);
+extern void unprotect_state(unsigned int);
 extern size_t get_state_size(int);
 extern size_t get_log_size(void *);
 extern size_t get_inc_log_size(void *);
@@ -258,10 +284,16 @@ extern size_t dirty_size(unsigned int, void *, double *);
 extern void clean_buffers_on_gvt(unsigned int, simtime_t);
 
 // Checkpointing API
+extern void checkpoints_init(void);
+extern void checkpoints_fini(void);
 extern void *log_full(int);
+extern void *log_incremental(int);
 extern void *log_state(int);
 extern void log_restore(int, state_t *);
+extern void restore_full(int, void *);
+extern void restore_incremental(int, void *);
 extern void log_delete(void *);
+extern void *log_lookup(void *, void *);
 
 
 
@@ -272,6 +304,8 @@ extern void lp_free(void *);
 extern void *lp_realloc(void *, size_t);
 extern void lp_alloc_init(void);
 extern void lp_alloc_fini(void);
+extern void lp_protect(void *, size_t, bool);
+extern void *lp_memory_region(unsigned int, size_t *, size_t *);
 
 
 #ifdef HAVE_LINUX_KERNEL_MAP_MODULE
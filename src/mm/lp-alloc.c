@@ -19,8 +19,9 @@
 * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 *
 * @file lp-alloc.c
-* @brief LP's memory pre-allocator. This layer stands below DyMeLoR, and is the
-* 		connection point to the Linux Kernel Module for Memory Management, when
+* @brief LP's memory pre-allocator. This layer stands below DyMeLoR, tracks writes
+* 		to LPs' memory via write protection when incremental logs are taken, and is
+* 		the connection point to the Linux Kernel Module for Memory Management, when
 * 		activated.
 * @author Alessandro Pellegrini
 */
@@ -28,9 +29,11 @@
 #include <unistd.h>
 #include <stddef.h>
 #include <string.h>
+#include <signal.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #if defined(OS_LINUX)
 #include <stropts.h>
@@ -48,8 +51,14 @@
 /// This variable keeps track of per-LP allocated (and assigned) memory regions
 static struct _lp_memory *lp_memory_regions;
 
+/// Size of the virtual memory region preallocated for each LP
+static size_t lp_region_size;
+
 void (*callback_function)(void);
 
+/// The SIGSEGV disposition found at startup, to which faults not due to write tracking are forwarded
+static struct sigaction previous_segv_action;
+
 
 #ifdef HAVE_LINUX_KERNEL_MAP_MODULE
 /// This variable keeps track of information needed by the Linux Kernel Module for activating cross-LP memory accesses
@@ -71,6 +80,11 @@ static void ECS_stub(int ds, unsigned int hitted_object){
 	printf("ECS synch started on pgd %d - start wait for hitted object num %d by %d\n", ds, hitted_object, current_lp);
 	fflush(stdout);
 
+	// A stackless LP cannot be suspended: it is given a stack and the event is processed again
+	if(LPS[current_lp]->stack == NULL) {
+		abort_stackless_event();
+	}
+
 	// do whatever you want, but you need to reopen access to the objects you cross-depend on before returning
 
 	// Generate a Rendez-Vous Mark
@@ -181,11 +195,86 @@ static void rootsim_cross_state_dependency_handler(void) { // for now a simple p
 
 
 
+/**
+* This is the SIGSEGV handler used to track writes to the LPs' memory without instrumenting
+* the model. Chunks are write-protected after each log: the first store to a page raises a
+* fault, which is resolved by granting write access to the page and notifying DyMeLoR that
+* the chunks in it are dirty. The store is then transparently re-executed.
+* Faults which are not due to the write protection are forwarded to the previous handler.
+*
+* @param sig The signal number
+* @param info Information about the fault, including the faulting address
+* @param context The user-level context of the faulting thread
+*/
+static void write_fault_handler(int sig, siginfo_t *info, void *context) {
+	char *addr = info->si_addr;
+	char *base = LP_PREALLOCATION_INITIAL_ADDRESS;
+	char *page;
+	unsigned int lid;
+
+	if(info->si_code == SEGV_ACCERR && addr >= base && addr < base + (size_t)n_prc * lp_region_size) {
+		page = (char *)((unsigned long)addr & ~((unsigned long)TRACKING_PAGE_SIZE - 1));
+		lid = (unsigned int)((size_t)(addr - base) / lp_region_size);
+
+		if(mprotect(page, TRACKING_PAGE_SIZE, PROT_READ | PROT_WRITE) == 0) {
+			dirty_pages(lid, page, TRACKING_PAGE_SIZE);
+			return;
+		}
+	}
+
+	// This is a real fault
+	if(previous_segv_action.sa_flags & SA_SIGINFO) {
+		previous_segv_action.sa_sigaction(sig, info, context);
+	} else if(previous_segv_action.sa_handler != SIG_DFL && previous_segv_action.sa_handler != SIG_IGN) {
+		previous_segv_action.sa_handler(sig);
+	} else {
+		// Restore the default action: the faulting instruction is re-executed and the process is killed
+		signal(SIGSEGV, SIG_DFL);
+	}
+}
+
+
+
+/**
+* This function tells where the memory preallocated for a LP is, and how much of it
+* has been handed out so far.
+*
+* @param lid The local id of the LP
+* @param size Where the size (in bytes) of the LP's memory is stored
+* @param used Where the amount of memory (in bytes) handed out to the LP is stored
+* @return The initial address of the LP's memory
+*/
+void *lp_memory_region(unsigned int lid, size_t *size, size_t *used) {
+	*size = lp_region_size;
+	*used = (size_t)((char *)lp_memory_regions[lid].brk - (char *)lp_memory_regions[lid].start);
+	return lp_memory_regions[lid].start;
+}
+
+
+
+/**
+* This function changes the write protection of a portion of a LP's memory, which must
+* start on a page boundary.
+*
+* @param base The initial address of the memory to (un)protect
+* @param size The size of the memory to (un)protect
+* @param protect If true, the memory becomes read-only, otherwise it is made writable again
+*/
+void lp_protect(void *base, size_t size, bool protect) {
+	size = (size + TRACKING_PAGE_SIZE - 1) & ~((size_t)TRACKING_PAGE_SIZE - 1);
+
+	if(mprotect(base, size, protect ? PROT_READ : PROT_READ | PROT_WRITE) == -1) {
+		rootsim_error(true, "Unable to change the protection of LP memory at %p: %s\n", base, strerror(errno));
+	}
+}
+
+
+
 void *lp_malloc_unscheduled(unsigned int lid, size_t s) {
 
 	void *ret = NULL;
 
-	if((char *)lp_memory_regions[lid].brk + s < (char *)lp_memory_regions[lid].start + PER_LP_PREALLOCATED_MEMORY) {
+	if((char *)lp_memory_regions[lid].brk + s < (char *)lp_memory_regions[lid].start + lp_region_size) {
 		ret = lp_memory_regions[lid].brk;
 		bzero(ret, s);
 		lp_memory_regions[lid].brk = (void *)((char *)lp_memory_regions[lid].brk + s);
@@ -249,60 +338,80 @@ void lp_alloc_init(void) {
 	#endif
 
 
-	// Linux Kernel has an internal limit to mmap requests, but consecutive calls are adjacent!
+	// The LPs share a fixed amount of virtual address space, so that the number of LPs
+	// is not bounded by it. The kernel module relies on PDP entry-aligned regions instead.
 	#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
-	unsigned int num_mmap = lp_memory_ioctl_info.mapped_processes * 2;
+	lp_region_size = PER_LP_PREALLOCATED_MEMORY;
 	char *addr = lp_memory_ioctl_info.addr;
 	#else
-	unsigned int num_mmap = n_prc * 2;
+	lp_region_size = PER_LP_PREALLOCATED_MEMORY;
+	if(n_prc > 0 && LP_PREALLOCATION_MAX_SPACE / n_prc < lp_region_size) {
+		lp_region_size = (LP_PREALLOCATION_MAX_SPACE / n_prc) & ~((size_t)TRACKING_PAGE_SIZE - 1);
+		rootsim_error(false, "Each of the %d LPs can allocate up to %zu KB of memory\n", n_prc, lp_region_size / 1024);
+	}
 	char *addr = LP_PREALLOCATION_INITIAL_ADDRESS;
 	#endif
-	size_t size = PER_LP_PREALLOCATED_MEMORY / 2;
-	int allocation_counter = 0;
+	size_t total = (size_t)n_prc * lp_region_size;
+	size_t mapped, size;
 
-	for(i = 0; i < num_mmap; i++) {
-
-		// map memory
-		addr = mmap((void*)addr,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED,0,0);
+	// Linux Kernel has an internal limit to mmap requests, but consecutive calls are adjacent!
+	// Physical memory is committed only when touched.
+	for(mapped = 0; mapped < total; mapped += size) {
+		size = total - mapped;
+		if(size > LP_PREALLOCATION_MMAP_SIZE) {
+			size = LP_PREALLOCATION_MMAP_SIZE;
+		}
 
 		// Sanity check, specifically for systems with low amount of memory
-		if(addr == MAP_FAILED) {
-			rootsim_error(true, "Unable to preallocate memory for LP %d. Try to reduce the number of LPs or recompile ROOT-Sim disabling the advanced memory allocator. Aborting...\n", i/2);
+		if(mmap(addr + mapped, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED|MAP_NORESERVE, 0, 0) == MAP_FAILED) {
+			rootsim_error(true, "Unable to preallocate memory for LP %d. Try to reduce the number of LPs or recompile ROOT-Sim disabling the advanced memory allocator. Aborting...\n", (unsigned int)(mapped / lp_region_size));
 		}
+	}
 
-		// Access the memory in write mode to force the kernel to create the page table entries
-		addr[0] = 'x';
-		addr[1] = addr[0];
+	// Keep track of the per-LP allocated memory
+	for(i = 0; i < n_prc; i++) {
+		lp_memory_regions[i].start = lp_memory_regions[i].brk = addr + (size_t)i * lp_region_size;
 
-		// Keep track of the per-LP allocated memory
-		if(allocation_counter % 2 == 0) {
-			lp_memory_regions[i/2].start = lp_memory_regions[i/2].brk = addr;
-		}
-		allocation_counter++;
-
-		addr += size;
+		#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
+		// Access the memory in write mode to force the kernel to create the page table entries
+		((char *)lp_memory_regions[i].start)[0] = 'x';
+		#endif
 	}
 
 	#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
 	/* post of the ioctl_table to the special device file - for internal initialization */
 	ret = ioctl(ioctl_fd, IOCTL_SET_VM_RANGE, &lp_memory_ioctl_info);
 	#endif
+
+	// Track writes to LPs' memory via write protection (no privilege or kernel module is required)
+	if(tracking_writes()) {
+		struct sigaction sa;
+
+		if(sysconf(_SC_PAGESIZE) != TRACKING_PAGE_SIZE) {
+			rootsim_error(true, "Incremental state saving requires a page size of %d bytes. Aborting...\n", TRACKING_PAGE_SIZE);
+		}
+
+		bzero(&sa, sizeof(struct sigaction));
+		sa.sa_sigaction = write_fault_handler;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigaction(SIGSEGV, &sa, &previous_segv_action);
+	}
 }
 
 
 void lp_alloc_fini(void) {
 
-	unsigned int i;
-
-	unsigned int num_mmap = n_prc * 2;
-	size_t size = PER_LP_PREALLOCATED_MEMORY / 2;
-	char *addr = LP_PREALLOCATION_INITIAL_ADDRESS;
+	if(tracking_writes()) {
+		sigaction(SIGSEGV, &previous_segv_action, NULL);
+	}
 
-	for(i = 0; i < num_mmap; i++) {
-		munmap(addr, size);
-		addr += size;
+	if(n_prc > 0) {
+		munmap(LP_PREALLOCATION_INITIAL_ADDRESS, (size_t)n_prc * lp_region_size);
 	}
 
+	rsfree(lp_memory_regions);
+
 	#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
 	close(ioctl_fd); // closing (hence releasing) the special device file
 	#endif
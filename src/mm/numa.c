@@ -0,0 +1,307 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+* @file numa.c
+* @brief This module places worker threads and LPs' memory on NUMA machines. Each
+*        worker thread is pinned to a core, filling one node before moving to the next
+*        one, and the memory preallocated for each LP is bound to the node of the thread
+*        which hosts the LP. Memory which is allocated by worker threads (checkpoints,
+*        queue nodes) is local to them on first touch, as threads never move. The
+*        topology is read from sysfs and memory is moved via system calls, so that no
+*        library is required.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+
+#if defined(OS_LINUX)
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#include <core/core.h>
+#include <arch/thread.h>
+#include <mm/malloc.h>
+#include <mm/dymelor.h>
+#include <mm/numa.h>
+#include <scheduler/process.h>
+
+
+unsigned int numa_nodes = 1;
+
+__thread unsigned int numa_node = 0;
+
+/// The core each worker thread is pinned to
+static unsigned int *thread_cpu = NULL;
+
+/// The NUMA node each worker thread runs on
+static unsigned int *thread_node = NULL;
+
+/// Placement errors are reported only once
+static bool placement_warned = false;
+
+
+#if defined(OS_LINUX)
+
+/**
+* This function reads the list of the cores of a NUMA node from sysfs
+*
+* @param node The NUMA node
+* @param cpu_node The array (indexed by core) where the node of each core listed is stored
+* @return false if the node does not exist
+*/
+static bool read_node_cpus(unsigned int node, unsigned int *cpu_node) {
+	char path[64];
+	FILE *f;
+	unsigned int first, last, c;
+	int sep;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+	f = fopen(path, "r");
+	if(f == NULL) {
+		return false;
+	}
+
+	// The list has the form "0-3,8,10-11"
+	while(fscanf(f, "%u", &first) == 1) {
+		last = first;
+		sep = fgetc(f);
+		if(sep == '-') {
+			if(fscanf(f, "%u", &last) != 1) {
+				break;
+			}
+			sep = fgetc(f);
+		}
+		for(c = first; c <= last && c < CPU_SETSIZE; c++) {
+			cpu_node[c] = node;
+		}
+		if(sep != ',') {
+			break;
+		}
+	}
+
+	fclose(f);
+	return true;
+}
+
+
+
+/**
+* This function initializes the NUMA placement. Available cores are ordered node by
+* node, and each worker thread of each kernel instance on the machine is given its own
+* core. The calling thread is pinned as well.
+*/
+void numa_init(void) {
+	cpu_set_t allowed;
+	unsigned int cpu_node[CPU_SETSIZE];
+	unsigned int cpus[CPU_SETSIZE];
+	unsigned int n_cpus = 0;
+	unsigned int node, c, t;
+
+	if(!rootsim_config.numa) {
+		return;
+	}
+
+	if(sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == -1) {
+		rootsim_error(false, "Unable to get the available cores: NUMA placement is disabled\n");
+		rootsim_config.numa = false;
+		return;
+	}
+
+	// Cores not listed by any node (e.g., on non-NUMA kernels) are on node 0
+	bzero(cpu_node, sizeof(cpu_node));
+	for(node = 0; node < NUMA_MAX_NODES; node++) {
+		if(read_node_cpus(node, cpu_node)) {
+			numa_nodes = node + 1;
+		}
+	}
+
+	for(node = 0; node < numa_nodes; node++) {
+		for(c = 0; c < CPU_SETSIZE; c++) {
+			if(CPU_ISSET(c, &allowed) && cpu_node[c] == node) {
+				cpus[n_cpus++] = c;
+			}
+		}
+	}
+
+	if(n_cores > n_cpus) {
+		rootsim_error(false, "%d worker threads are pinned to %d cores: some cores are shared\n", n_cores, n_cpus);
+	}
+
+	thread_cpu = rsalloc(sizeof(unsigned int) * n_cores);
+	thread_node = rsalloc(sizeof(unsigned int) * n_cores);
+	for(t = 0; t < n_cores; t++) {
+		thread_cpu[t] = cpus[(kid * n_cores + t) % n_cpus];
+		thread_node[t] = cpu_node[thread_cpu[t]];
+	}
+
+	numa_bind_thread();
+}
+
+
+
+/**
+* This function pins the calling worker thread to its core. It must be called by each
+* worker thread before it touches any memory.
+*/
+void numa_bind_thread(void) {
+	cpu_set_t mask;
+
+	if(!rootsim_config.numa) {
+		return;
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(thread_cpu[tid], &mask);
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &mask) == -1) {
+		rootsim_error(false, "Unable to pin thread %d to core %d\n", tid, thread_cpu[tid]);
+	}
+
+	numa_node = thread_node[tid];
+}
+
+
+
+/**
+* This function binds the memory preallocated for a LP to the NUMA node of the worker
+* thread hosting it. Pages which have already been touched are moved, while the others
+* will be allocated on the node when first touched. This must be called whenever the
+* LP is bound to a thread.
+*
+* @param lid The local id of the LP
+*/
+void numa_place_LP(unsigned int lid) {
+	unsigned long mask;
+	size_t size, used;
+	void *start;
+
+	if(!rootsim_config.numa) {
+		return;
+	}
+
+	start = lp_memory_region(lid, &size, &used);
+	mask = 1UL << numa_node_of_thread(LPS[lid]->worker_thread);
+
+	if(syscall(SYS_mbind, start, (unsigned long)size, MPOL_PREFERRED, &mask, NUMA_MAX_NODES + 1, MPOL_MF_MOVE) == -1 && !placement_warned) {
+		placement_warned = true;
+		rootsim_error(false, "Unable to place the memory of LP %d on NUMA node %d\n", lid, numa_node_of_thread(LPS[lid]->worker_thread));
+	}
+}
+
+
+
+/**
+* This function samples the pages of a LP's memory, to tell how many of them are not
+* on the NUMA node of the worker thread hosting the LP. Pages which have never been
+* touched are not counted.
+*
+* @param lid The local id of the LP
+* @param sampled Where the number of sampled pages is stored
+* @param remote Where the number of sampled pages lying on a remote node is stored
+*/
+void numa_sample_LP(unsigned int lid, unsigned int *sampled, unsigned int *remote) {
+	void *pages[NUMA_SAMPLE_PAGES];
+	int status[NUMA_SAMPLE_PAGES];
+	size_t size, used, page_size, n_pages, stride;
+	unsigned int i, count;
+	char *start;
+
+	*sampled = *remote = 0;
+
+	if(!rootsim_config.numa) {
+		return;
+	}
+
+	page_size = (size_t)getpagesize();
+	start = lp_memory_region(lid, &size, &used);
+	n_pages = (used + page_size - 1) / page_size;
+	stride = n_pages / NUMA_SAMPLE_PAGES + 1;
+
+	for(count = 0; count < NUMA_SAMPLE_PAGES && count * stride < n_pages; count++) {
+		pages[count] = start + count * stride * page_size;
+	}
+
+	// With no target nodes, move_pages() only tells where the pages are
+	if(count == 0 || syscall(SYS_move_pages, 0, (unsigned long)count, pages, NULL, status, 0) == -1) {
+		return;
+	}
+
+	for(i = 0; i < count; i++) {
+		if(status[i] < 0) {
+			continue;
+		}
+		(*sampled)++;
+		if((unsigned int)status[i] != numa_node_of_thread(LPS[lid]->worker_thread)) {
+			(*remote)++;
+		}
+	}
+}
+
+#else /* OS_LINUX */
+
+void numa_init(void) {
+	if(rootsim_config.numa) {
+		rootsim_error(false, "NUMA placement is supported only on Linux: it is disabled\n");
+		rootsim_config.numa = false;
+	}
+}
+
+void numa_bind_thread(void) {}
+
+void numa_place_LP(unsigned int lid) {
+	(void)lid;
+}
+
+void numa_sample_LP(unsigned int lid, unsigned int *sampled, unsigned int *remote) {
+	(void)lid;
+	*sampled = *remote = 0;
+}
+
+#endif /* OS_LINUX */
+
+
+
+/**
+* This function finalizes the NUMA placement
+*/
+void numa_fini(void) {
+	if(thread_cpu != NULL) {
+		rsfree(thread_cpu);
+		rsfree(thread_node);
+	}
+}
+
+
+
+/**
+* This function tells on which NUMA node a worker thread runs
+*
+* @param thread The id of the worker thread
+* @return The NUMA node of the thread (0 if placement is not enabled)
+*/
+unsigned int numa_node_of_thread(unsigned int thread) {
+	if(thread_node == NULL) {
+		return 0;
+	}
+	return thread_node[thread];
+}
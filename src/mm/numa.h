@@ -0,0 +1,50 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+* @file numa.h
+* @brief NUMA-aware placement of worker threads and LPs' memory
+*/
+#pragma once
+#ifndef _ROOTSIM_NUMA_H
+#define _ROOTSIM_NUMA_H
+
+
+/// Maximum number of NUMA nodes which can be handled
+#define NUMA_MAX_NODES		64
+
+/// Maximum number of pages of each LP's memory which are sampled to measure remote placement
+#define NUMA_SAMPLE_PAGES	64
+
+
+/// Number of NUMA nodes in the machine (1 if placement is not enabled)
+extern unsigned int numa_nodes;
+
+/// NUMA node of the core the calling worker thread is pinned to
+extern __thread unsigned int numa_node;
+
+
+extern void numa_init(void);
+extern void numa_fini(void);
+extern void numa_bind_thread(void);
+extern unsigned int numa_node_of_thread(unsigned int thread);
+extern void numa_place_LP(unsigned int lid);
+extern void numa_sample_LP(unsigned int lid, unsigned int *sampled, unsigned int *remote);
+
+#endif /* _ROOTSIM_NUMA_H */
@@ -0,0 +1,314 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+* @file slab.c
+* @brief This module implements per-thread size-class pools for small objects.
+* 	 Each worker thread keeps a free list per size class, refilled by carving
+* 	 large slabs. Since objects can be released by a thread different from
+* 	 the one which allocated them (e.g., messages sent across threads),
+* 	 exceeding objects are moved in batches to a global, lock-protected depot,
+* 	 from which other threads refill before allocating new slabs. Slabs are
+* 	 never given back to the system.
+* 	 With NUMA placement, slabs are aligned to their size and their header
+* 	 tells the node of the thread which carved (and first touched) them.
+* 	 There is one depot per node, and objects released on a different node
+* 	 are sent back, in batches, to the depot of their own node.
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <core/core.h>
+#include <mm/slab.h>
+#include <mm/malloc.h>
+#include <mm/numa.h>
+#include <arch/atomic.h>
+
+
+/// A free object. Its first word is the link of the free list, so that chains of list nodes can be released as they are
+struct slab_obj {
+	struct slab_obj *next;		/// Next free object in the same batch
+	struct slab_obj *next_batch;	/// Next batch in the depot (meaningful only for a batch's first object)
+};
+
+/// The free list of one size class in a per-thread pool
+struct slab_pool {
+	struct slab_obj *free;
+	unsigned int count;
+};
+
+/// The global depot of one size class, keeping batches of SLAB_BATCH objects
+struct slab_depot {
+	spinlock_t lock;
+	struct slab_obj *batches;
+};
+
+
+/// Header at the beginning of each slab, when NUMA placement is enabled
+struct slab_header {
+	unsigned int node;		/// NUMA node of the thread which carved the slab
+} __attribute__((aligned(64)));
+
+
+/// Per-thread pools, one for each size class
+static __thread struct slab_pool pools[SLAB_CLASSES];
+
+/// Per-thread batches of released objects which belong to other NUMA nodes, one for each node and size class
+static __thread struct slab_pool (*foreign)[SLAB_CLASSES] = NULL;
+
+/// Global depots, one for each NUMA node and size class. The spinlocks are zero-initialized, i.e. unlocked
+static struct slab_depot depots[NUMA_MAX_NODES][SLAB_CLASSES];
+
+
+/// The header of the slab an object belongs to (meaningful only with NUMA placement)
+#define slab_header_of(obj)	((struct slab_header *)((unsigned long)(obj) & ~((unsigned long)SLAB_SIZE - 1)))
+
+
+
+static inline unsigned int size_class(size_t size) {
+	return (unsigned int)((size + SLAB_GRANULARITY - 1) / SLAB_GRANULARITY) - 1;
+}
+
+
+
+/**
+* Refill an empty per-thread pool, taking a batch from the global depot if available,
+* or carving a brand new slab otherwise.
+*
+* @param cls The size class to refill
+*/
+static void slab_refill(unsigned int cls) {
+	struct slab_pool *pool = &pools[cls];
+	struct slab_depot *depot = &depots[numa_node][cls];
+	size_t obj_size = (cls + 1) * SLAB_GRANULARITY;
+	size_t offset = 0;
+	unsigned int i, n;
+	char *slab = NULL;
+
+	if(depot->batches != NULL) {
+		spin_lock(&depot->lock);
+		if(depot->batches != NULL) {
+			pool->free = depot->batches;
+			depot->batches = depot->batches->next_batch;
+			spin_unlock(&depot->lock);
+			pool->count = SLAB_BATCH;
+			return;
+		}
+		spin_unlock(&depot->lock);
+	}
+
+	if(rootsim_config.numa) {
+		if(posix_memalign((void **)&slab, SLAB_SIZE, SLAB_SIZE) != 0) {
+			rootsim_error(true, "Error in Memory Allocation, aborting...");
+		}
+		((struct slab_header *)slab)->node = numa_node;
+		offset = sizeof(struct slab_header);
+	} else {
+		slab = rsalloc(SLAB_SIZE);
+	}
+
+	n = (SLAB_SIZE - offset) / obj_size;
+	for(i = 0; i < n; i++) {
+		((struct slab_obj *)(slab + offset + i * obj_size))->next = (i + 1 < n ? (struct slab_obj *)(slab + offset + (i + 1) * obj_size) : NULL);
+	}
+	pool->free = (struct slab_obj *)(slab + offset);
+	pool->count = n;
+}
+
+
+
+/**
+* Move batches of objects from a per-thread pool to the global depot, as long
+* as the pool keeps more than two batches.
+*
+* @param cls The size class to drain
+*/
+static void slab_drain(unsigned int cls) {
+	struct slab_pool *pool = &pools[cls];
+	struct slab_depot *depot = &depots[numa_node][cls];
+	struct slab_obj *batch, *last;
+	unsigned int i;
+
+	while(pool->count > 2 * SLAB_BATCH) {
+		batch = pool->free;
+		last = batch;
+		for(i = 1; i < SLAB_BATCH; i++) {
+			last = last->next;
+		}
+		pool->free = last->next;
+		pool->count -= SLAB_BATCH;
+		last->next = NULL;
+
+		spin_lock(&depot->lock);
+		batch->next_batch = depot->batches;
+		depot->batches = batch;
+		spin_unlock(&depot->lock);
+	}
+}
+
+
+
+/**
+* Release an object which belongs to a slab of another NUMA node. Objects are
+* gathered in per-node batches, which are handed to the depot of their node
+* when they are full, so that they are reused by the threads of that node.
+*
+* @param obj The object to release
+* @param cls The size class of the object
+* @param node The NUMA node of the slab the object belongs to
+*/
+static void slab_release_foreign(struct slab_obj *obj, unsigned int cls, unsigned int node) {
+	struct slab_pool *batch;
+	struct slab_depot *depot = &depots[node][cls];
+
+	if(foreign == NULL) {
+		foreign = rsalloc(sizeof(*foreign) * numa_nodes);
+		bzero(foreign, sizeof(*foreign) * numa_nodes);
+	}
+
+	batch = &foreign[node][cls];
+	obj->next = batch->free;
+	batch->free = obj;
+
+	if(++batch->count == SLAB_BATCH) {
+		spin_lock(&depot->lock);
+		batch->free->next_batch = depot->batches;
+		depot->batches = batch->free;
+		spin_unlock(&depot->lock);
+
+		batch->free = NULL;
+		batch->count = 0;
+	}
+}
+
+
+
+/**
+* Tell whether an object lies on the NUMA node of the calling thread. This is
+* always the case if NUMA placement is not enabled, or if the object is not
+* pooled.
+*
+* @param ptr The object
+* @param size The size which was requested when allocating the object
+* @return true if the object is local to the calling thread
+*/
+bool slab_is_local(void *ptr, size_t size) {
+	if(!rootsim_config.numa || size > SLAB_MAX_OBJ_SIZE) {
+		return true;
+	}
+	return slab_header_of(ptr)->node == numa_node;
+}
+
+
+
+/**
+* Allocate an object from the calling thread's pool
+*
+* @param size The size of the object. Objects of the same size class are interchangeable.
+* @return A pointer to the (uninitialized) object
+*/
+void *slab_alloc(size_t size) {
+	unsigned int cls;
+	struct slab_obj *obj;
+
+	if(size > SLAB_MAX_OBJ_SIZE) {
+		return rsalloc(size);
+	}
+
+	cls = size_class(size);
+	if(pools[cls].free == NULL) {
+		slab_refill(cls);
+	}
+
+	obj = pools[cls].free;
+	pools[cls].free = obj->next;
+	pools[cls].count--;
+	return obj;
+}
+
+
+
+/**
+* Release an object into the calling thread's pool
+*
+* @param ptr The object to release
+* @param size The size which was requested when allocating the object
+*/
+void slab_free(void *ptr, size_t size) {
+	slab_free_chain(ptr, ptr, 1, size);
+}
+
+
+
+/**
+* Release a chain of objects of the same size into the calling thread's pool
+* in one shot. Objects in the chain must be linked through their first word,
+* as it happens with list nodes, and the link of the last object is overwritten.
+*
+* @param first The first object of the chain
+* @param last The last object of the chain
+* @param count The number of objects in the chain
+* @param size The size which was requested when allocating the objects
+*/
+void slab_free_chain(void *first, void *last, unsigned int count, size_t size) {
+	unsigned int cls;
+	struct slab_obj *obj, *next;
+	unsigned int node;
+
+	if(count == 0) {
+		return;
+	}
+
+	if(size > SLAB_MAX_OBJ_SIZE) {
+		for(obj = first; count > 0; count--) {
+			next = obj->next;
+			rsfree(obj);
+			obj = next;
+		}
+		return;
+	}
+
+	cls = size_class(size);
+
+	// Objects of other nodes go back to their own node
+	if(rootsim_config.numa) {
+		for(obj = first; count > 0; count--) {
+			next = obj->next;
+			node = slab_header_of(obj)->node;
+			if(node == numa_node) {
+				obj->next = pools[cls].free;
+				pools[cls].free = obj;
+				pools[cls].count++;
+			} else {
+				slab_release_foreign(obj, cls, node);
+			}
+			obj = next;
+		}
+	} else {
+		((struct slab_obj *)last)->next = pools[cls].free;
+		pools[cls].free = first;
+		pools[cls].count += count;
+	}
+
+	if(pools[cls].count > 2 * SLAB_BATCH) {
+		slab_drain(cls);
+	}
+}
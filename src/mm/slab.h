@@ -0,0 +1,54 @@
+/**
+*			Copyright (C) 2008-2015 HPDCS Group
+*			http://www.dis.uniroma1.it/~hpdcs
+*
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*
+* @file slab.h
+* @brief Per-thread size-class pools for the small, fixed-size objects which
+* 	 are allocated and released at a high rate (e.g., list nodes).
+*/
+#pragma once
+#ifndef _ROOTSIM_SLAB_H
+#define _ROOTSIM_SLAB_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+
+/// Granularity (in bytes) of size classes
+#define SLAB_GRANULARITY	16
+
+/// Objects larger than this are not pooled, and go directly to rsalloc()/rsfree()
+#define SLAB_MAX_OBJ_SIZE	1024
+
+/// Number of size classes
+#define SLAB_CLASSES		(SLAB_MAX_OBJ_SIZE / SLAB_GRANULARITY)
+
+/// Size (in bytes) of the slabs carved into objects when a pool runs dry
+#define SLAB_SIZE		(64 * 1024)
+
+/// Number of objects moved at once between a per-thread pool and the global depot
+#define SLAB_BATCH		256
+
+
+extern void *slab_alloc(size_t size);
+extern void slab_free(void *ptr, size_t size);
+extern void slab_free_chain(void *first, void *last, unsigned int count, size_t size);
+extern bool slab_is_local(void *ptr, size_t size);
+
+#endif /* _ROOTSIM_SLAB_H */
@@ -82,6 +82,7 @@ void LogState(unsigned int lid) {
 			break;
 
 		case PERIODIC_STATE_SAVING:
+		case AUTONOMIC_STATE_SAVING:
 			if(LPS[lid]->from_last_ckpt >= LPS[lid]->ckpt_period) {
 				take_snapshot = true;
 				LPS[lid]->from_last_ckpt = 0;
@@ -255,14 +256,14 @@ state_t *find_time_barrier(int lid, simtime_t simtime) {
 		barrier_state = list_head(LPS[lid]->queue_states);
 	}
 
-/*
-	// TODO Search for the first full log before the gvt
-	while(true) {
-		if(is_incremental(current->log) == false)
-			break;
-	  	current = list_prev(current);
+	// An incremental log can be restored only on top of the full log it depends on,
+	// so the barrier must be moved back to it, not to lose it upon fossil collection
+	while(barrier_state != NULL && is_incremental(barrier_state->log)) {
+		barrier_state = list_prev(barrier_state);
+	}
+	if(barrier_state == NULL) {
+		barrier_state = list_head(LPS[lid]->queue_states);
 	}
-*/
 
 	return barrier_state;
 }
@@ -315,6 +316,62 @@ void set_checkpoint_period(unsigned int lid, int period) {
 }
 
 
+/**
+* This function recomputes the checkpointing period of the LPs bound to the calling worker
+* thread, according to what has been observed during the last GVT phase. The period which
+* minimizes the per-event overhead is the classic optimal interval:
+*
+* 	chi = sqrt(2 * delta_s / (P_r * delta_e))
+*
+* where delta_s is the average cost of a checkpoint, P_r is the rollback frequency and
+* delta_e is the cost of coasting forward one event, which is estimated by the average
+* execution time of events.
+* LPs which did not take checkpoints or execute events in the last GVT phase keep their period.
+*
+* For further information, please see the paper:
+* 	Y.-B. Lin, B. R. Preiss, W. M. Loucks, E. D. Lazowska
+* 	Selecting the Checkpoint Interval in Time Warp Simulation
+* 	Proceedings of the 7th Workshop on Parallel and Distributed Simulation
+* 	1993
+*/
+void autonomic_checkpoint_period(void) {
+	unsigned int i, lid;
+	double events, ckpts, rollbacks;
+	double ckpt_cost, event_cost;
+	int period;
+
+	for(i = 0; i < n_prc_per_thread; i++) {
+		lid = LPS_bound[i]->lid;
+
+		events = statistics_get_lp_data(lid, STAT_EVENT);
+		ckpts = statistics_get_lp_data(lid, STAT_CKPT);
+		rollbacks = statistics_get_lp_data(lid, STAT_ROLLBACK);
+
+		if(D_EQUAL_ZERO(events) || D_EQUAL_ZERO(ckpts)) {
+			continue;
+		}
+
+		ckpt_cost = statistics_get_lp_data(lid, STAT_CKPT_TIME) / ckpts;
+		event_cost = statistics_get_lp_data(lid, STAT_EVENT_TIME) / events;
+
+		// Without rollbacks, or if coasting forward is for free, checkpoints are pure overhead
+		if(D_EQUAL_ZERO(rollbacks) || D_EQUAL_ZERO(event_cost)) {
+			period = MAX_CKPT_PERIOD;
+		} else {
+			period = (int)ceil(sqrt(2 * ckpt_cost / (rollbacks / events * event_cost)));
+		}
+
+		if(period < 1)
+			period = 1;
+		if(period > MAX_CKPT_PERIOD)
+			period = MAX_CKPT_PERIOD;
+
+		set_checkpoint_period(lid, period);
+	}
+}
+
+
+
 /**
 * This function tells the logging subsystem to take a LP state log
 * upon the next invocation to <LogState>(), independently of the current
@@ -40,6 +40,11 @@
 #define  COPY_STATE_SAVING 		1
 /// Periodic State Saving checkpointing interval
 #define  PERIODIC_STATE_SAVING		2
+/// Periodic State Saving, with a per-LP checkpointing interval tuned at runtime
+#define  AUTONOMIC_STATE_SAVING		3
+
+/// Upper bound for the checkpointing interval of Periodic State Saving
+#define  MAX_CKPT_PERIOD		40
 
 
 extern bool processing_silent_execution;
@@ -69,6 +74,7 @@ extern state_t *update_time_barrier(unsigned int, state_t *, simtime_t);
 extern void clean_queue_states(unsigned int lid, simtime_t new_gvt);
 extern void rebuild_state(unsigned int lid, state_t *state_pointer, simtime_t time);
 extern void set_checkpoint_period(unsigned int lid, int period);
+extern void autonomic_checkpoint_period(void);
 extern void force_LP_checkpoint(unsigned int lid);
 extern unsigned int silent_execution(unsigned int lid, void *state_buffer, msg_t *evt, msg_t *final_evt);
 #endif /* _STATE_MGNT_H_ */
@@ -42,6 +42,26 @@
 #include <gvt/gvt.h>
 
 
+/// Per worker thread lock-free stacks of the LPs which have pending bottom halves
+static struct _LP_state * volatile *pending_bottom_halves;
+
+
+/**
+* This function initializes the queues subsystem
+*/
+void queues_init(void) {
+	pending_bottom_halves = rsalloc(sizeof(LP_state *) * n_cores);
+	bzero((void *)pending_bottom_halves, sizeof(LP_state *) * n_cores);
+}
+
+
+
+/**
+* This function finalizes the queues subsystem
+*/
+void queues_fini(void) {
+	rsfree((void *)pending_bottom_halves);
+}
 
 
 
@@ -133,12 +153,36 @@ msg_t *advance_to_next_event(unsigned int lid) {
 
 
 
+/**
+* This function pushes a LP on the list of LPs with pending bottom halves of the
+* worker thread hosting it. A LP is in at most one list at a time, as tracked by
+* its bh_pending flag, which must have been set by the caller.
+*
+* @param lp The LP which has pending bottom halves
+*/
+static void notify_bottom_halves(LP_state *lp) {
+	LP_state *old_head;
+	unsigned int thread = lp->worker_thread;
+
+	do {
+		old_head = pending_bottom_halves[thread];
+		lp->bh_next = old_head;
+	} while(!CAS((volatile unsigned long long *)&pending_bottom_halves[thread], (unsigned long long)old_head, (unsigned long long)lp));
+}
+
+
+
 /**
 * Insert a message in the bottom halft of a locally-hosted LP. Of course,
 * the LP must be locally hosted. This is guaranteed by the fact
 * that the only point where this function is called is from Send(),
 * which checks whether the LP is hosted locally from this kernel
 * instance or not.
+* The message is copied into a list node, which is pushed on the LP's
+* bottom halves without taking any lock. The LP is then pushed on the list of LPs
+* with pending bottom halves of its worker thread, so that the receiver does not
+* have to look at all its LPs. The same node is later linked
+* into the input queue, so no further copy is made.
 *
 * @author Alessandro Pellegrini
 *
@@ -147,36 +191,71 @@ msg_t *advance_to_next_event(unsigned int lid) {
 void insert_bottom_half(msg_t *msg) {
 
 	unsigned int lid = GidToLid(msg->receiver);
+	struct rootsim_list_node *node;
+	struct rootsim_list_node *old_head;
+
+	node = list_allocate_node(LPS[lid]->queue_in);
+	memcpy(node->data, msg, sizeof(msg_t));
+
+	do {
+		old_head = LPS[lid]->bottom_halves;
+		node->next = old_head;
+	} while(!CAS((volatile unsigned long long *)&LPS[lid]->bottom_halves, (unsigned long long)old_head, (unsigned long long)node));
 
-	spin_lock(&LPS[lid]->lock);
-	(void)list_insert_tail(LPS[lid]->bottom_halves, msg);
-	spin_unlock(&LPS[lid]->lock);
+	// Tell the worker thread hosting the LP, unless it has already been told
+	if(iCAS(&LPS[lid]->bh_pending, 0, 1)) {
+		notify_bottom_halves(LPS[lid]);
+	}
 }
 
 
 /**
-* Process bottom halves received by all the LPs hosted by the current KLT
+* Process bottom halves received by all the LPs hosted by the current KLT. Only the
+* LPs which have been notified to this thread are looked at.
 *
 * @author Alessandro Pellegrini
 */
 void process_bottom_halves(void) {
-	unsigned int i;
+	LP_state *lp, *next_lp;
 	unsigned int lid_receiver;
 	msg_t *msg_to_process;
 	msg_t *matched_msg;
-	list(msg_t) processing;
+	struct rootsim_list_node *processing;
+	struct rootsim_list_node *node, *next;
+	struct rootsim_list_node *local_node;
+	struct rootsim_list_node *start_node;
 
-	for(i = 0; i < n_prc_per_thread; i++) {
+	lp = (LP_state *)XCHG((volatile unsigned long long *)&pending_bottom_halves[tid], 0ULL);
 
-		spin_lock(&LPS_bound[i]->lock);
-		processing = LPS_bound[i]->bottom_halves;
-		LPS_bound[i]->bottom_halves = new_list(msg_t);
-		spin_unlock(&LPS_bound[i]->lock);
+	for(; lp != NULL; lp = next_lp) {
+		next_lp = lp->bh_next;
 
-		while(!list_empty(processing)) {
-			msg_to_process = list_head(processing);
+		// The LP has been migrated: its new worker thread takes care of it
+		if(lp->worker_thread != tid) {
+			notify_bottom_halves(lp);
+			continue;
+		}
 
-			lid_receiver = msg_to_process->receiver;
+		// From now on, new messages notify the LP again
+		lp->bh_pending = 0;
+
+		// Detach the whole batch of pending messages at once. Nodes
+		// were pushed in LIFO order: reverse them to get arrival order.
+		node = (struct rootsim_list_node *)XCHG((volatile unsigned long long *)&lp->bottom_halves, 0ULL);
+		processing = NULL;
+		while(node != NULL) {
+			next = node->next;
+			node->next = processing;
+			processing = node;
+			node = next;
+		}
+
+		while(processing != NULL) {
+			node = processing;
+			processing = processing->next;
+			msg_to_process = (msg_t *)node->data;
+
+			lid_receiver = GidToLid(msg_to_process->receiver);
 
 			if(!receive_control_msg(msg_to_process)) {
 				goto expunge_msg;
@@ -187,16 +266,23 @@ void process_bottom_halves(void) {
 				// It's an antimessage
 				case negative:
 
-					statistics_post_lp_data(msg_to_process->receiver, STAT_ANTIMESSAGE, 1.0);
+					statistics_post_lp_data(lid_receiver, STAT_ANTIMESSAGE, 1.0);
 
-					// Find the message matching the antimessage
-					matched_msg = list_tail(LPS[lid_receiver]->queue_in);
-					while(matched_msg != NULL && matched_msg->mark != msg_to_process->mark) {
-						matched_msg = list_prev(matched_msg);
+					// Find the message matching the antimessage. If, for any reason,
+					// the index does not know it, fall back to scanning the input queue
+					matched_msg = hash_table_remove(LPS[lid_receiver]->mark_index, msg_to_process->mark);
+					if(matched_msg != NULL) {
+						statistics_post_lp_data(lid_receiver, STAT_ANTIMESSAGE_INDEX, 1.0);
+					} else {
+						statistics_post_lp_data(lid_receiver, STAT_ANTIMESSAGE_SCAN, 1.0);
+						matched_msg = list_tail(LPS[lid_receiver]->queue_in);
+						while(matched_msg != NULL && matched_msg->mark != msg_to_process->mark) {
+							matched_msg = list_prev(matched_msg);
+						}
 					}
 
 					if(matched_msg == NULL) {
-						rootsim_error(false, "LP %d Received an antimessage with mark %llu at LP %u from LP %u, but no such mark found in the input queue!\n", LPS_bound[i]->lid, msg_to_process->mark, msg_to_process->receiver, msg_to_process->sender);
+						rootsim_error(false, "LP %d Received an antimessage with mark %llu at LP %u from LP %u, but no such mark found in the input queue!\n", lp->lid, msg_to_process->mark, msg_to_process->receiver, msg_to_process->sender);
 						printf("Message Content:"
 							"sender: %d\n"
 							"receiver: %d\n"
@@ -228,6 +314,10 @@ void process_bottom_halves(void) {
 						}
 
 						// Delete the matched message
+						if(LPS[lid_receiver]->queue_in_index != NULL) {
+							skip_index_remove(LPS[lid_receiver]->queue_in_index, matched_msg->timestamp, list_container_of(matched_msg));
+						}
+						msg_release_content(matched_msg);
 						list_delete_by_content(LPS[lid_receiver]->queue_in, matched_msg);
 					}
 
@@ -236,7 +326,24 @@ void process_bottom_halves(void) {
 				// It's a positive message
 				case positive:
 
-					msg_to_process = list_insert(LPS[lid_receiver]->queue_in, timestamp, msg_to_process);
+					// Keep the input queue on the NUMA node of the thread hosting the LP
+					if(!slab_is_local(node, sizeof(struct rootsim_list_node) + sizeof(msg_t))) {
+						local_node = list_allocate_node(LPS[lid_receiver]->queue_in);
+						memcpy(local_node, node, sizeof(struct rootsim_list_node) + sizeof(msg_t));
+						list_release_node(LPS[lid_receiver]->queue_in, node);
+						node = local_node;
+						msg_to_process = (msg_t *)node->data;
+						statistics_post_lp_data(lid_receiver, STAT_REMOTE_MSG, 1.0);
+					}
+
+					// The node is moved into the input queue, not copied
+					if(LPS[lid_receiver]->queue_in_index != NULL) {
+						start_node = skip_index_insert(LPS[lid_receiver]->queue_in_index, msg_to_process->timestamp, node);
+						msg_to_process = list_insert_node_after(LPS[lid_receiver]->queue_in, timestamp, start_node, node);
+					} else {
+						msg_to_process = list_insert_node(LPS[lid_receiver]->queue_in, timestamp, node);
+					}
+					hash_table_insert(LPS[lid_receiver]->mark_index, msg_to_process->mark, msg_to_process);
 
 					// Check if we've just inserted an out-of-order event
 					if(msg_to_process->timestamp < lvt(lid_receiver)) {
@@ -246,7 +353,7 @@ void process_bottom_halves(void) {
 						}
 						LPS[lid_receiver]->state = LP_STATE_ROLLBACK;
 					}
-					break;
+					continue;
 
 				// It's a control message
 				case other:
@@ -261,9 +368,12 @@ void process_bottom_halves(void) {
 			}
 
 		    expunge_msg:
-			list_pop(processing);
+			msg_release_content(msg_to_process);
+			list_release_node(LPS[lid_receiver]->queue_in, node);
 		}
-		rsfree(processing);
+
+		// Incoming messages might have changed the next event of this LP
+		stf_update_LP(lp->lid);
 	}
 }
 
@@ -37,10 +37,18 @@
 #define QUEUE_IN	0
 #define QUEUE_OUT	1
 
+/// The input queue is an ordered list, scanned from the tail upon insertions
+#define INPUT_QUEUE_LIST	0
+
+/// The input queue is an ordered list indexed by a skiplist
+#define INPUT_QUEUE_SKIPLIST	1
+
 
 extern simtime_t last_event_timestamp(unsigned int);
 extern simtime_t next_event_timestamp(unsigned int);
 extern msg_t *advance_to_next_event(unsigned int);
+extern void queues_init(void);
+extern void queues_fini(void);
 extern void insert_bottom_half(msg_t *msg);
 extern void process_bottom_halves(void);
 extern unsigned long long generate_mark(unsigned int);
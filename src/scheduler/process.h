@@ -36,6 +36,8 @@
 
 #include <mm/state.h>
 #include <datatypes/list.h>
+#include <datatypes/hash.h>
+#include <datatypes/skiplist.h>
 #include <scheduler/scheduler.h>
 #include <arch/ult.h>
 #include <arch/atomic.h>
@@ -85,6 +87,9 @@ typedef struct _LP_state {
 	/// ID of the worker thread towards which the LP is bound
 	unsigned int	worker_thread;
 
+	/// Position of the LP in the ready queue of its worker thread
+	unsigned int	ready_idx;
+
 	/// Current execution state of the LP
 	short unsigned int state;
 
@@ -106,14 +111,29 @@ typedef struct _LP_state {
 	/// Pointer to the last correctly elaborated event
 	msg_t		*bound;
 
+	/// Skiplist index of the input queue, to find where incoming messages go (NULL if the input queue is a plain list)
+	skip_index	*queue_in_index;
+
+	/// State up to which the LP has still to be fossil collected (NULL if there is nothing to collect)
+	state_t		*fossil_barrier;
+
+	/// Index of the input queue messages by mark, used to annihilate antimessages
+	hash_table	*mark_index;
+
 	/// Output messages queue
 	list(msg_hdr_t)	queue_out;
 
 	/// Saved states queue
 	list(state_t)	queue_states;
 
-	/// Bottom halves queue
-	list(msg_t)	bottom_halves;
+	/// Bottom halves: lock-free stack of list nodes carrying a msg_t, pushed by any thread and drained by the owner
+	struct rootsim_list_node * volatile bottom_halves;
+
+	/// Set while the LP is in the list of LPs with pending bottom halves of some worker thread
+	volatile unsigned int	bh_pending;
+
+	/// Next LP in the list of LPs with pending bottom halves
+	struct _LP_state	*bh_next;
 
 	/// Processed rendezvous queue
 	list(msg_t)	rendezvous_queue;
@@ -38,11 +38,14 @@
 #include <mm/state.h>
 #include <mm/malloc.h>
 #include <mm/dymelor.h>
+#include <mm/numa.h>
 #include <statistics/statistics.h>
 #include <arch/thread.h>
 #include <communication/communication.h>
 #include <gvt/gvt.h>
+#include <gvt/ccgs.h>
 #include <statistics/statistics.h>
+#include <queues/queues.h>
 
 #include <mm/modules/ktblmgr/ktblmgr.h>
 
@@ -53,6 +56,18 @@
 /// Maintain LPs' simulation and execution states
 LP_state **LPS = NULL;
 
+/// LP control blocks, in one contiguous array which LPS points into
+static LP_state *LP_control_blocks = NULL;
+
+/// Minimum timestamps of the messages in transit of all LPs, n_cores entries per LP
+static simtime_t *LP_min_in_transit = NULL;
+
+/// Application-level arguments, passed to each LP in its INIT event
+static char **INIT_args;
+
+/// Number of application-level arguments
+static int INIT_args_count;
+
 /// Each KLT has a binding towards some LPs. This is the structure used to keep track of LPs currently being handled
 __thread LP_state **LPS_bound = NULL;
 
@@ -73,16 +88,26 @@ __thread void *current_state;
 
 static barrier_t INIT_barrier;
 
+/// Barrier used by worker threads to agree on a new LPs binding
+static barrier_t rebalance_barrier;
+
+/// How many events the calling worker thread can execute in a row on the same LP
+static __thread unsigned int batch_size = 0;
+
 
 /*
 * This function initializes the scheduler. In particular, it relies on MPI to broadcast to every simulation kernel process
 * which is the actual scheduling algorithm selected.
+* LP control blocks are only allocated here: they are initialized by the worker threads hosting them.
+*
+* @param argc The number of application-level arguments
+* @param argv The application-level arguments, passed to the LPs in the INIT event
 *
 * @author Francesco Quaglia
 *
 * @param sched The scheduler selected initially, but master can decide to change it, so slaves must rely on what master send to them
 */
-void scheduler_init(void) {
+void scheduler_init(int argc, char **argv) {
 
 	register unsigned int i;
 
@@ -97,36 +122,53 @@ void scheduler_init(void) {
 		}
 	}
 */
-	// Allocate LPS control blocks
+	INIT_args_count = argc;
+	INIT_args = argv;
+
+	// Allocate LPS control blocks. Zeroed pages are not touched here, so that each
+	// one is first touched by the worker thread which initializes its LPs
+	LP_control_blocks = rscalloc(n_prc, sizeof(LP_state));
+	LP_min_in_transit = rsalloc(sizeof(simtime_t) * n_prc * n_cores);
 	LPS = (LP_state **)rsalloc(n_prc * sizeof(LP_state *));
 	for (i = 0; i < n_prc; i++) {
-		LPS[i] = (LP_state *)rsalloc(sizeof(LP_state));
-		bzero(LPS[i], sizeof(LP_state));
-
-		// Allocate memory for the outgoing buffer 
-		LPS[i]->outgoing_buffer.max_size = INIT_OUTGOING_MSG;
-		LPS[i]->outgoing_buffer.outgoing_msgs = rsalloc(sizeof(msg_t) * INIT_OUTGOING_MSG);
+		LPS[i] = &LP_control_blocks[i];
 	}
 
 	// Initialize the INIT barrier
 	barrier_init(&INIT_barrier, n_cores);
 
+	// Initialize the barrier for LPs migration
+	barrier_init(&rebalance_barrier, n_cores);
+
+	queues_init();
 }
 
 
 
 static void destroy_LPs(void) {
 	register unsigned int i;
+	struct rootsim_list_node *bh, *bh_next;
 
 	for(i = 0; i < n_prc; i++) {
 		rsfree(LPS[i]->queue_in);
+		if(LPS[i]->queue_in_index != NULL) {
+			skip_index_destroy(LPS[i]->queue_in_index);
+		}
+		hash_table_destroy(LPS[i]->mark_index);
 		rsfree(LPS[i]->queue_out);
 		rsfree(LPS[i]->queue_states);
-		rsfree(LPS[i]->bottom_halves);
+
+		// Release messages which were never delivered
+		for(bh = LPS[i]->bottom_halves; bh != NULL; bh = bh_next) {
+			bh_next = bh->next;
+			list_release_node(LPS[i]->queue_in, bh);
+		}
 
 		// Destroy stacks
 		#ifdef ENABLE_ULT
-		lp_free(LPS[i]->stack);
+		if(LPS[i]->stack != NULL) {
+			lp_free(LPS[i]->stack);
+		}
 		#endif
 	}
 
@@ -140,16 +182,56 @@ static void destroy_LPs(void) {
 * @author Alessandro Pellegrini
 */
 void scheduler_fini(void) {
-	register unsigned int i;
 
 	destroy_LPs();
 
-	for (i = 0; i < n_prc; i++) {
-		rsfree(LPS[i]);
-	}
 	rsfree(LPS);
+	rsfree(LP_min_in_transit);
+	rsfree(LP_control_blocks);
 
 	rsfree(LPS_bound);
+
+	queues_fini();
+}
+
+
+
+/**
+* This function executes the event which has been set up by <activate_LP>() on the
+* current LP, keeping track of the time spent in the model. It runs either on the
+* LP's user-level thread or, for LPs which have no stack, directly on the stack of
+* the kernel thread.
+*/
+static void LP_execute_event(void) {
+	#ifdef EXTRA_CHECKS
+	unsigned long long hash1, hash2;
+	hash1 = hash2 = 0;
+
+	if(current_evt->size > 0) {
+		hash1 = XXH64(msg_content(current_evt), current_evt->size, current_lp);
+	}
+	#endif
+
+	// Process the event
+	timer event_timer;
+	timer_start(event_timer);
+
+	ProcessEvent[current_lp](LidToGid(current_lp), current_evt->timestamp, current_evt->type, msg_content(current_evt), current_evt->size, current_state);
+
+	int delta_event_timer = timer_value_micro(event_timer);
+
+	#ifdef EXTRA_CHECKS
+	if(current_evt->size > 0) {
+		hash2 = XXH64(msg_content(current_evt), current_evt->size, current_lp);
+	}
+
+	if(hash1 != hash2) {
+                rootsim_error(true, "Error, LP %d has modified the payload of event %d during its processing. Aborting...\n", current_lp, current_evt->type);
+	}
+	#endif
+
+	statistics_post_lp_data(current_lp, STAT_EVENT, 1.0);
+	statistics_post_lp_data(current_lp, STAT_EVENT_TIME, delta_event_timer);
 }
 
 
@@ -163,16 +245,13 @@ void scheduler_fini(void) {
 * simulation state, a SIGSEGV signal is raised and the LP might be descheduled if it is not safe
 * to perform the remote memory access. This is the only case where control is not returned to simulation
 * thread explicitly by this wrapper.
+* Only LPs which have been given a stack by <create_LP_stack>() run this loop.
 *
 * @author Francesco Quaglia
 *
 * @param args arguments passed to the LP main loop. Currently, this is not used.
 */
 static void LP_main_loop(void *args) {
-	#ifdef EXTRA_CHECKS
-	unsigned long long hash1, hash2;
-	hash1 = hash2 = 0;
-	#endif
 
 	(void)args; // this is to make the compiler stop complaining about unused args
 
@@ -183,32 +262,7 @@ static void LP_main_loop(void *args) {
 
 	while(true) {
 
-		#ifdef EXTRA_CHECKS
-		if(current_evt->size > 0) {
-			hash1 = XXH64(current_evt->event_content, current_evt->size, current_lp);
-		}
-		#endif
-
-		// Process the event
-		timer event_timer;
-		timer_start(event_timer);
-
-		ProcessEvent[current_lp](LidToGid(current_lp), current_evt->timestamp, current_evt->type, current_evt->event_content, current_evt->size, current_state);
-
-		int delta_event_timer = timer_value_micro(event_timer);
-
-		#ifdef EXTRA_CHECKS
-		if(current_evt->size > 0) {
-			hash2 = XXH64(current_evt->event_content, current_evt->size, current_lp);
-		}
-
-		if(hash1 != hash2) {
-                        rootsim_error(true, "Error, LP %d has modified the payload of event %d during its processing. Aborting...\n", current_lp, current_evt->type);
-		}
-		#endif
-
-		statistics_post_lp_data(current_lp, STAT_EVENT, 1.0);
-		statistics_post_lp_data(current_lp, STAT_EVENT_TIME, delta_event_timer);
+		LP_execute_event();
 
 		// Give back control to the simulation kernel's user-level thread
 		#ifdef ENABLE_ULT
@@ -221,14 +275,74 @@ static void LP_main_loop(void *args) {
 
 
 
+/**
+* This function gives a LP its own user-level thread. LPs are initially stackless: their events
+* are processed directly on the stack of the kernel thread, which spares the stack memory and the
+* two context switches per event. A stack is needed only by LPs which block in the middle of an
+* event, and it is created the first time this happens.
+* The creation of a user-level thread relies on global variables, so concurrent creations are
+* serialized.
+*
+* @param lid The local id of the LP
+*/
+void create_LP_stack(unsigned int lid) {
+	#ifdef ENABLE_ULT
+	static spinlock_t creation_lock = {0};
+
+	if(LPS[lid]->stack != NULL) {
+		return;
+	}
+
+	spin_lock(&creation_lock);
+	LPS[lid]->stack = get_ult_stack(lid, LP_STACK_SIZE);
+	context_create(&LPS[lid]->context, LP_main_loop, NULL, LPS[lid]->stack, LP_STACK_SIZE);
+	spin_unlock(&creation_lock);
+
+	// The LP has never run on this stack: a rollback must restart it from scratch
+	memcpy(&LPS[lid]->default_context, &LPS[lid]->context, sizeof(LP_context_t));
+	#else
+	(void)lid;
+	#endif
+}
+
+
+
+#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
+/**
+* This function is called when a stackless LP must block in the middle of an event. Its
+* execution cannot be suspended, as it lives on the stack of the kernel thread: the LP is given
+* a stack, the partial execution of the event is discarded and the LP is rolled back to right
+* before the event, which will be processed again on the LP's user-level thread. If the event
+* is the first one (typically INIT), no state has been logged yet: the LP is brought back to
+* its initial, empty state instead. Control goes back to <activate_LP>().
+*/
+void abort_stackless_event(void) {
+	unsigned int lid = current_lp;
+	msg_t *last_correct_event = list_prev(current_evt);
+
+	create_LP_stack(lid);
+
+	// Nothing produced by the aborted event has left the LP so far
+	discard_outgoing_msgs(lid);
+
+	if(last_correct_event == NULL) {
+		reset_state();
+		LPS[lid]->current_base_pointer = NULL;
+	}
+
+	LPS[lid]->bound = last_correct_event;
+	LPS[lid]->state = LP_STATE_ROLLBACK;
+
+	context_restore(&kernel_context);
+}
+#endif
 
 
 
 /**
- * This function initializes a LP execution context. It allocates page-aligned memory for efficiency
- * reasons, and then calls <context_create>() which does the final trick.
- * <context_create>() uses global variables: LPs must therefore be intialized before creating new kernel threads
- * for supporting concurrent execution of LPs.
+ * This function initializes a LP control block, and schedules the special INIT event to the LP.
+ * It is called by the worker thread hosting the LP, so that the LP's queues and metadata are
+ * allocated by that thread. The LP's stack is only created if the LP blocks.
  *
  * @author Alessandro Pellegrini
  *
@@ -238,10 +352,11 @@ static void LP_main_loop(void *args) {
  */
 void initialize_LP(unsigned int lp) {
 	unsigned int i;
+	msg_t init_event;
 
-	// Allocate LP stack
+	// LPs are stackless until they need to block: see create_LP_stack()
 	#ifdef ENABLE_ULT
-	LPS[lp]->stack = get_ult_stack(lp, LP_STACK_SIZE);
+	LPS[lp]->stack = NULL;
 	#endif
 
 	// Set the initial checkpointing period for this LP.
@@ -259,9 +374,15 @@ void initialize_LP(unsigned int lp) {
 
 	// Initialize the queues
 	LPS[lp]->queue_in = new_list(msg_t);
+	LPS[lp]->queue_in_index = NULL;
+	LPS[lp]->fossil_barrier = NULL;
+	if(rootsim_config.input_queue == INPUT_QUEUE_SKIPLIST) {
+		LPS[lp]->queue_in_index = new_skip_index();
+	}
+	LPS[lp]->mark_index = new_hash_table();
 	LPS[lp]->queue_out = new_list(msg_hdr_t);
 	LPS[lp]->queue_states = new_list(state_t);
-	LPS[lp]->bottom_halves = new_list(msg_t);
+	LPS[lp]->bottom_halves = NULL;
 	LPS[lp]->rendezvous_queue = new_list(msg_t);
 
 	// Assign the local ID to the LP
@@ -273,7 +394,7 @@ void initialize_LP(unsigned int lp) {
 	// No event has been processed so far
 	LPS[lp]->bound = NULL;
 
-	LPS[lp]->outgoing_buffer.min_in_transit = rsalloc(sizeof(simtime_t) * n_cores);
+	LPS[lp]->outgoing_buffer.min_in_transit = &LP_min_in_transit[(size_t)lp * n_cores];
 	for(i = 0; i < n_cores; i++) {
 		LPS[lp]->outgoing_buffer.min_in_transit[i] = INFTY;
 	}
@@ -284,10 +405,26 @@ void initialize_LP(unsigned int lp) {
 	LPS[lp]->ECS_synch_table[0] = lp;
 	#endif
 
-	// Create user thread
-	#ifdef ENABLE_ULT
-	context_create(&LPS[lp]->context, LP_main_loop, NULL, LPS[lp]->stack, LP_STACK_SIZE);
-	#endif
+	dymelor_init_LP(lp);
+
+	// Schedule an INIT event to the newly instantiated LP, carrying the application-level args
+	bzero(&init_event, sizeof(msg_t));
+	init_event.sender = LidToGid(lp);
+	init_event.receiver = LidToGid(lp);
+	init_event.type = INIT;
+	init_event.timestamp = 0.0;
+	init_event.send_time = 0.0;
+	init_event.mark = generate_mark(lp);
+	init_event.size = INIT_args_count;
+	init_event.message_kind = positive;
+
+	// Copy the relevant string pointers to the INIT event payload
+	if(INIT_args_count > 0) {
+		msg_set_content(&init_event, INIT_args, INIT_args_count * sizeof(char *));
+	}
+
+	(void)list_insert_head(LPS[lp]->queue_in, &init_event);
+	LPS[lp]->state_log_forced = true;
 }
 
 
@@ -324,9 +461,17 @@ void activate_LP(unsigned int lp, simtime_t lvt, void *evt, void *state) {
 	lp_alloc_schedule();
 
 	#ifdef ENABLE_ULT
-	context_switch(&kernel_context, &LPS[lp]->context);
+	if(LPS[lp]->stack != NULL) {
+		context_switch(&kernel_context, &LPS[lp]->context);
+	} else {
+		#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
+		// If the LP must block, abort_stackless_event() brings control back here
+		if(context_save(&kernel_context) == 0)
+		#endif
+		LP_execute_event();
+	}
 	#else
-	LP_main_loop(NULL);
+	LP_execute_event();
 	#endif
 
 	// Deactivate memory view for the current LP if no conflict has arisen
@@ -344,10 +489,11 @@ void activate_LP(unsigned int lp, simtime_t lvt, void *evt, void *state) {
 
 
 /**
-* This function is used to create a temporary binding between LPs and KLT.
-* Whenever it is invoked, the binding is recreated, depending on the specified
-* policy. Currently, only a fixed binding is implemented, so calling again this
-* function deterministically regenerates the same binding.
+* This function is used to create the initial binding between LPs and KLT.
+* LPs are assigned to threads in blocks. The binding is created only once:
+* later changes to it are applied at GVT boundaries by <rebalance_LPs>().
+* Each thread initializes the LPs bound to it, so this must be called by all
+* worker threads before any of them starts processing events.
 *
 * @author Alessandro Pellegrini
 */
@@ -398,6 +544,198 @@ void rebind_LPs(void) {
 			buf1--;
 		}
 	}
+
+	// Initialize the bound LPs, and place their memory on the NUMA node of this thread
+	for(i = 0; i < n_prc_per_thread; i++) {
+		initialize_LP((unsigned int)(LPS_bound[i] - LP_control_blocks));
+		numa_place_LP(LPS_bound[i]->lid);
+	}
+
+	// The binding has changed: rebuild the ready queue and the termination checks of this thread
+	stf_rebuild_ready_queue();
+	ccgs_rebuild_check_list();
+}
+
+
+
+/**
+* This function moves one LP to a different worker thread. It must be called
+* when no worker thread is operating on the LP, namely between the two
+* barriers of <rebalance_LPs>().
+* The LP user-level thread (if any) is recreated, so that it does not carry any
+* thread-local reference of the previous worker thread. This is safe because
+* a non-blocked LP has no pending execution on its stack between two events.
+*
+* @param lid The local id of the LP to migrate
+* @param new_thread The worker thread which will host the LP from now on
+*/
+static void migrate_LP(unsigned int lid, unsigned int new_thread) {
+	unsigned int old_thread = LPS[lid]->worker_thread;
+	simtime_t *min_in_transit = LPS[lid]->outgoing_buffer.min_in_transit;
+
+	// Messages in transit are now accounted to the new worker thread
+	min_in_transit[new_thread] = min(min_in_transit[new_thread], min_in_transit[old_thread]);
+	min_in_transit[old_thread] = INFTY;
+
+	LPS[lid]->worker_thread = new_thread;
+
+	// The LP's memory follows it to the NUMA node of the new thread
+	if(numa_node_of_thread(new_thread) != numa_node_of_thread(old_thread)) {
+		numa_place_LP(lid);
+	}
+
+	#ifdef ENABLE_ULT
+	if(LPS[lid]->stack != NULL) {
+		context_create(&LPS[lid]->context, LP_main_loop, NULL, LPS[lid]->stack, LP_STACK_SIZE);
+		memcpy(&LPS[lid]->default_context, &LPS[lid]->context, sizeof(LP_context_t));
+	}
+	#endif
+}
+
+
+
+/**
+* This function computes a new LPs-to-threads binding, starting from the load
+* that each LP has shown during the last GVT phase. The most loaded thread gives
+* LPs to the least loaded one (possibly idle), until the imbalance drops below
+* LP_REBALANCE_THRESHOLD or no LP can be moved without reversing the imbalance.
+* Blocked LPs are never migrated, and every thread keeps at least one LP.
+* This is executed by one thread only, while the others wait on a barrier.
+*/
+static void compute_LPs_binding(void) {
+	unsigned int i, lid;
+	unsigned int src, dst;
+	unsigned int moves, max_moves;
+	unsigned int candidate;
+	unsigned int *thread_lps;
+	double *lp_load, *thread_load;
+	double total_load = 0.0, total_time = 0.0;
+	double gap;
+
+	lp_load = rsalloc(sizeof(double) * n_prc);
+	thread_load = rsalloc(sizeof(double) * n_cores);
+	thread_lps = rsalloc(sizeof(unsigned int) * n_cores);
+	bzero(thread_load, sizeof(double) * n_cores);
+	bzero(thread_lps, sizeof(unsigned int) * n_cores);
+
+	// Events might be too fine-grained to be timed: fall back to event counts
+	for(lid = 0; lid < n_prc; lid++) {
+		total_time += statistics_get_lp_data(lid, STAT_EVENT_TIME);
+	}
+
+	for(lid = 0; lid < n_prc; lid++) {
+		if(D_DIFFER_ZERO(total_time)) {
+			lp_load[lid] = statistics_get_lp_data(lid, STAT_EVENT_TIME);
+		} else {
+			lp_load[lid] = statistics_get_lp_data(lid, STAT_EVENT);
+		}
+		thread_load[LPS[lid]->worker_thread] += lp_load[lid];
+		thread_lps[LPS[lid]->worker_thread]++;
+		total_load += lp_load[lid];
+	}
+
+	max_moves = n_prc / n_cores + 1;
+	for(moves = 0; moves < max_moves; moves++) {
+
+		src = dst = 0;
+		for(i = 1; i < n_cores; i++) {
+			if(thread_load[i] > thread_load[src])
+				src = i;
+			if(thread_load[i] < thread_load[dst])
+				dst = i;
+		}
+
+		if(thread_load[src] - thread_load[dst] <= LP_REBALANCE_THRESHOLD * total_load / n_cores || thread_lps[src] <= 1) {
+			break;
+		}
+
+		// Pick the most loaded LP which does not reverse the imbalance
+		gap = (thread_load[src] - thread_load[dst]) / 2;
+		candidate = IDLE_PROCESS;
+		for(lid = 0; lid < n_prc; lid++) {
+			if(LPS[lid]->worker_thread != src || is_blocked_state(LPS[lid]->state) || LPS[lid]->state == LP_STATE_READY_FOR_SYNCH)
+				continue;
+			if(D_EQUAL_ZERO(lp_load[lid]) || lp_load[lid] > gap)
+				continue;
+			if(candidate == IDLE_PROCESS || lp_load[lid] > lp_load[candidate])
+				candidate = lid;
+		}
+
+		if(candidate == IDLE_PROCESS) {
+			break;
+		}
+
+		migrate_LP(candidate, dst);
+		thread_load[src] -= lp_load[candidate];
+		thread_load[dst] += lp_load[candidate];
+		thread_lps[src]--;
+		thread_lps[dst]++;
+	}
+
+	rsfree(thread_lps);
+	rsfree(thread_load);
+	rsfree(lp_load);
+}
+
+
+
+/**
+* This function allows LPs to migrate across worker threads, to balance the load
+* when the workload is skewed. It is called by all worker threads at GVT boundaries,
+* when no GVT reduction is in progress, and it is therefore a synchronization point.
+* One thread computes the new binding while the others wait, then each thread
+* rebuilds its set of bound LPs.
+*/
+void rebalance_LPs(void) {
+	unsigned int i;
+
+	// Messages notified to the current worker threads are delivered before LPs move, so that
+	// no bottom half is forwarded to a thread which might have already reported to the next GVT round
+	thread_barrier(&rebalance_barrier);
+	process_bottom_halves();
+
+	if(thread_barrier(&rebalance_barrier)) {
+		compute_LPs_binding();
+	}
+	thread_barrier(&rebalance_barrier);
+
+	n_prc_per_thread = 0;
+	for(i = 0; i < n_prc; i++) {
+		if(LPS[i]->worker_thread == tid) {
+			LPS_bound[n_prc_per_thread++] = LPS[i];
+		}
+	}
+
+	stf_rebuild_ready_queue();
+	ccgs_rebuild_check_list();
+}
+
+
+
+/**
+* Adaptive event batching. This function tunes the number of events which the calling
+* worker thread can execute in a row on the same LP, on the rollbacks which occurred on
+* the bound LPs in the last GVT interval: long batches are worth only as long as they do
+* not let LPs run into stragglers.
+*/
+void update_batch_size(void) {
+	unsigned int i;
+	double events = 0.0, rollbacks = 0.0;
+
+	for(i = 0; i < n_prc_per_thread; i++) {
+		events += statistics_get_lp_data(LPS_bound[i]->lid, STAT_EVENT);
+		rollbacks += statistics_get_lp_data(LPS_bound[i]->lid, STAT_ROLLBACK);
+	}
+
+	if(D_EQUAL_ZERO(events) || batch_size == 0) {
+		return;
+	}
+
+	if(rollbacks / events > BATCH_HIGH_ROLLBACKS) {
+		batch_size = max(batch_size / 2, 1U);
+	} else if(rollbacks / events < BATCH_LOW_ROLLBACKS) {
+		batch_size = min(batch_size * 2, (unsigned int)MAX_BATCH_EVENTS);
+	}
 }
 
 
@@ -405,12 +743,16 @@ void rebind_LPs(void) {
 /**
 * This function checks wihch LP must be activated (if any),
 * and in turn activates it. This is used only to support forward execution.
+* Once a LP has been activated, it keeps on executing its next events, up to
+* the batch size, as long as they are safe with respect to the other bound LPs:
+* no other LP has a smaller timestamp and nothing has been received by the LP.
 *
 * @author Alessandro Pellegrini
 */
 void schedule(void) {
 
 	unsigned int lid;
+	unsigned int batch = 0;
 	msg_t *event;
 	void *state;
 
@@ -418,6 +760,11 @@ void schedule(void) {
 	bool resume_execution = false;
 	#endif
 
+	// The first time, take the batch size from the configuration
+	if(batch_size == 0) {
+		batch_size = rootsim_config.batch_events;
+	}
+
 	// Find next LP to be executed, depending on the chosen scheduler
 	switch (rootsim_config.scheduler) {
 
@@ -437,70 +784,91 @@ void schedule(void) {
 
 	// If we have to rollback
     	if(LPS[lid]->state == LP_STATE_ROLLBACK) {
-		rollback(lid);
+		// A LP aborted in its first event has already been reset by abort_stackless_event()
+		if(LPS[lid]->bound != NULL) {
+			rollback(lid);
+		}
 
 		// Discard any possible execution state related to a blocked execution
 		#ifdef ENABLE_ULT
-		memcpy(&LPS[lid]->context, &LPS[lid]->default_context, sizeof(LP_context_t));
+		if(LPS[lid]->stack != NULL) {
+			memcpy(&LPS[lid]->context, &LPS[lid]->default_context, sizeof(LP_context_t));
+		}
 		#endif
 
 		LPS[lid]->state = LP_STATE_READY;
 		send_outgoing_msgs(lid);
+		stf_update_LP(lid);
 		return;
 	}
 
-	if(LPS[lid]->state != LP_STATE_READY_FOR_SYNCH) {
-		event = advance_to_next_event(lid);
-	} else {
-		event = LPS[lid]->bound;
-	}
+	do {
+		if(LPS[lid]->state != LP_STATE_READY_FOR_SYNCH) {
+			event = advance_to_next_event(lid);
+		} else {
+			event = LPS[lid]->bound;
+		}
 
 
-	// Sanity check: if we get here, it means that lid is a LP which has
-	// at least one event to be executed. If advance_to_next_event() returns
-	// NULL, it means that lid has no events to be executed. This is
-	// a critical condition and we abort.
-	if(event == NULL) {
-		rootsim_error(true, "Critical condition: LP %d seems to have events to be processed, but I cannot find them. Aborting...\n", lid);
-	}
+		// Sanity check: if we get here, it means that lid is a LP which has
+		// at least one event to be executed. If advance_to_next_event() returns
+		// NULL, it means that lid has no events to be executed. This is
+		// a critical condition and we abort.
+		if(event == NULL) {
+			rootsim_error(true, "Critical condition: LP %d seems to have events to be processed, but I cannot find them. Aborting...\n", lid);
+		}
 
-	// Manage the INIT barrier
-//	if(event->type == INIT) {
-//		thread_barrier(&INIT_barrier);
-//	}
+		// Manage the INIT barrier
+	//	if(event->type == INIT) {
+	//		thread_barrier(&INIT_barrier);
+	//	}
 
-	if(!process_control_msg(event)) {
-		return;
-	}
+		if(!process_control_msg(event)) {
+			stf_update_LP(lid);
+			return;
+		}
 
-	state = LPS[lid]->current_base_pointer;
+		state = LPS[lid]->current_base_pointer;
 
-	#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
-	// In case we are resuming an interrupted execution, we keep track of this.
-	// If at the end of the scheduling the LP is not blocked, we can unblokc all the remote objects
-	if(LPS[lid]->state == LP_STATE_READY_FOR_SYNCH) {
-		resume_execution = true;
-	}
-	#endif
-	
-	// Schedule the LP user-level thread
-	LPS[lid]->state = LP_STATE_RUNNING;
-	activate_LP(lid, lvt(lid), event, state);
-	if(!is_blocked_state(LPS[lid]->state)) {
-		LPS[lid]->state = LP_STATE_READY;
-		send_outgoing_msgs(lid);
-	}
+		#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
+		// In case we are resuming an interrupted execution, we keep track of this.
+		// If at the end of the scheduling the LP is not blocked, we can unblokc all the remote objects
+		resume_execution = (LPS[lid]->state == LP_STATE_READY_FOR_SYNCH);
+		#endif
 
-	#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
-	if(resume_execution && !is_blocked_state(LPS[lid]->state)) {
-		unblock_synchronized_objects(lid);
-		// This is to avoid domino effect when relying on rendezvous messages
-		force_LP_checkpoint(lid);
-	}
-	#endif
+		// Schedule the LP user-level thread
+		LPS[lid]->state = LP_STATE_RUNNING;
+		activate_LP(lid, lvt(lid), event, state);
+
+		#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
+		// A stackless LP which had to block must first be rolled back (see abort_stackless_event())
+		if(LPS[lid]->state == LP_STATE_ROLLBACK) {
+			stf_update_LP(lid);
+			return;
+		}
+		#endif
+
+		if(!is_blocked_state(LPS[lid]->state)) {
+			LPS[lid]->state = LP_STATE_READY;
+			send_outgoing_msgs(lid);
+		}
+
+		#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
+		if(resume_execution && !is_blocked_state(LPS[lid]->state)) {
+			unblock_synchronized_objects(lid);
+			// This is to avoid domino effect when relying on rendezvous messages
+			force_LP_checkpoint(lid);
+		}
+		#endif
+
+		// Log the state, if needed
+		LogState(lid);
 
-	// Log the state, if needed
-	LogState(lid);
+		// The bound has moved forward (or the LP got blocked): update its position
+		stf_update_LP(lid);
 
+		// The next event is safe if the LP is still the first one in the ready queue and
+		// no message (possibly a straggler, or one sent by the LP to itself) is waiting for it
+	} while(++batch < batch_size && LPS[lid]->state == LP_STATE_READY && LPS[lid]->bottom_halves == NULL && smallest_timestamp_first() == lid);
 }
 
@@ -48,16 +48,36 @@
 #define MAX_CONSECUTIVE_IDLE_CYCLES	1000
 
 
+/// Relative load imbalance (w.r.t. the average per-thread load) tolerated before migrating LPs
+#define LP_REBALANCE_THRESHOLD		0.2
+
+
+/// Upper bound to the number of events executed in a row on the same LP by the adaptive batching
+#define MAX_BATCH_EVENTS		64
+
+/// Rollbacks per processed event above which the adaptive batching halves the batch size
+#define BATCH_HIGH_ROLLBACKS		0.05
+
+/// Rollbacks per processed event below which the adaptive batching doubles the batch size
+#define BATCH_LOW_ROLLBACKS		0.01
+
+
 /// Smallest Timestamp Scheduler's Code
 #define SMALLEST_TIMESTAMP_FIRST	0
 
 /* Functions invoked by other modules */
-extern void scheduler_init(void);
+extern void scheduler_init(int argc, char **argv);
 extern void scheduler_fini(void);
 extern void schedule(void);
 extern void initialize_LP(unsigned int lp);
 extern void activate_LP(unsigned int lp, simtime_t lvt, void *evt, void *state);
+extern void create_LP_stack(unsigned int lid);
+#ifdef HAVE_LINUX_KERNEL_MAP_MODULE
+extern void abort_stackless_event(void);
+#endif
 extern void rebind_LPs(void);
+extern void rebalance_LPs(void);
+extern void update_batch_size(void);
 
 
 extern bool receive_control_msg(msg_t *);
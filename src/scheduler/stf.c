@@ -4,48 +4,251 @@
 #include <scheduler/scheduler.h>
 #include <scheduler/process.h>
 #include <gvt/gvt.h>
+#include <mm/malloc.h>
+#include <statistics/statistics.h>
+
+
+/// An entry of the per-thread ready queue: the LP and its scheduling key
+struct ready_entry {
+	simtime_t	key;
+	LP_state	*lp;
+};
+
+/// Per-thread ready queue, organized as a binary min-heap over the bound LPs
+static __thread struct ready_entry *ready_queue = NULL;
+
+/// Number of LPs currently kept in the ready queue
+static __thread unsigned int ready_queue_size = 0;
+
+/// Width of the optimism window of the calling worker thread (0 until it is opened)
+static __thread simtime_t time_window = 0.0;
+
+/// Events with a timestamp beyond this value are not executed by the calling worker thread
+static __thread simtime_t window_horizon = INFTY;
+
+/// The GVT which the optimism window was last moved to
+static __thread simtime_t window_gvt = -1.0;
+
+/// Has some event been held back by the optimism window since the last GVT reduction?
+static __thread bool window_throttled = false;
+
+
 
 /**
-* This function implements the smallest timestamp first algorithm
-*
-* @author Francesco Quaglia
+* Compute the scheduling key of a LP: the timestamp of its next event, or INFTY
+* if the LP is blocked or has nothing to process.
 *
-* @return The Id of the Logical Process qith the smallest timestamp
+* @param lp The LP control block
+* @return The key used to order the LP in the ready queue
 */
-unsigned int smallest_timestamp_first(void) {
+static inline simtime_t ready_key(LP_state *lp) {
+	simtime_t evt_time;
+
+	// Blocked LPs cannot be scheduled
+	if(is_blocked_state(lp->state)) {
+		return INFTY;
+	}
+
+	evt_time = next_event_timestamp(lp->lid);
+	if(evt_time < 0) {
+		return INFTY;
+	}
+
+	return evt_time;
+}
+
+
+// Ties are broken on the LP id, so that the choice is the same the linear scan would do
+static inline bool ready_less(struct ready_entry *a, struct ready_entry *b) {
+	if(D_EQUAL(a->key, b->key)) {
+		return a->lp->lid < b->lp->lid;
+	}
+
+	return a->key < b->key;
+}
+
+
+static inline void ready_place(unsigned int pos, struct ready_entry *entry) {
+	ready_queue[pos] = *entry;
+	ready_queue[pos].lp->ready_idx = pos;
+}
+
+
+static void ready_sift_up(unsigned int pos) {
+	struct ready_entry entry = ready_queue[pos];
+	unsigned int parent;
+
+	while(pos > 0) {
+		parent = (pos - 1) / 2;
+		if(!ready_less(&entry, &ready_queue[parent]))
+			break;
+		ready_place(pos, &ready_queue[parent]);
+		pos = parent;
+	}
+	ready_place(pos, &entry);
+}
+
+
+static void ready_sift_down(unsigned int pos) {
+	struct ready_entry entry = ready_queue[pos];
+	unsigned int child;
+
+	while((child = 2 * pos + 1) < ready_queue_size) {
+		if(child + 1 < ready_queue_size && ready_less(&ready_queue[child + 1], &ready_queue[child]))
+			child++;
+		if(!ready_less(&ready_queue[child], &entry))
+			break;
+		ready_place(pos, &ready_queue[child]);
+		pos = child;
+	}
+	ready_place(pos, &entry);
+}
+
+
+
+/**
+* This function (re)builds the ready queue of the calling worker thread from
+* the current LPs binding. It must be called whenever LPS_bound changes.
+*/
+void stf_rebuild_ready_queue(void) {
+	unsigned int i;
+
+	ready_queue = rsrealloc(ready_queue, sizeof(struct ready_entry) * (n_prc_per_thread > 0 ? n_prc_per_thread : 1));
+	ready_queue_size = n_prc_per_thread;
 
-	simtime_t min_timestamp = -1, evt_time = -1;
-	simtime_t min_bound = INFTY;
-	unsigned int next = IDLE_PROCESS;
-	register unsigned int i;
+	for(i = 0; i < n_prc_per_thread; i++) {
+		ready_queue[i].lp = LPS_bound[i];
+		ready_queue[i].key = ready_key(LPS_bound[i]);
+		LPS_bound[i]->ready_idx = i;
+	}
 
-	// For each local process
-	for (i = 0; i < n_prc_per_thread; i++) {
+	// Floyd's heap construction
+	for(i = ready_queue_size / 2; i > 0; i--) {
+		ready_sift_down(i - 1);
+	}
 
-		min_bound = min(min_bound, (LPS_bound[i]->bound != NULL ? LPS_bound[i]->bound->timestamp : 0.0));
+	// The first time, open the optimism window from the initial GVT
+	if(rootsim_config.time_window > 0.0 && D_EQUAL_ZERO(time_window)) {
+		time_window = rootsim_config.time_window;
+		window_horizon = time_window;
+	}
+}
 
-		// Blocked LPs cannot be scheduled
-		if(is_blocked_state(LPS_bound[i]->state)) {
-			continue;
+
+
+/**
+* Optimism throttling. This function moves the optimism window of the calling worker
+* thread to a newly computed GVT. If the window is adaptive, its width is first tuned
+* on what happened in the last GVT interval: it is halved if the efficiency of the bound
+* LPs (committed over processed events) is low or if they rolled back too often, while
+* it grows if the efficiency is high and some event has been held back by the window.
+* The window cannot stall the simulation: if the GVT did not move forward, no event is
+* held back until the next reduction.
+*
+* @param gvt The newly computed GVT
+*/
+void stf_update_time_window(simtime_t gvt) {
+	unsigned int i;
+	double events = 0.0, committed = 0.0, rollbacks = 0.0;
+	double efficiency;
+
+	if(rootsim_config.adaptive_window) {
+		for(i = 0; i < n_prc_per_thread; i++) {
+			events += statistics_get_lp_data(LPS_bound[i]->lid, STAT_EVENT);
+			committed += statistics_get_lp_data(LPS_bound[i]->lid, STAT_COMMITTED);
+			rollbacks += statistics_get_lp_data(LPS_bound[i]->lid, STAT_ROLLBACK);
 		}
 
-		// Compute the next event's timestamp. Translate the id from the local binding to the local ID
-		evt_time = next_event_timestamp(LPS_bound[i]->lid);
+		if(!D_EQUAL_ZERO(events)) {
+			efficiency = committed / events;
 
-		if(evt_time > -1) {
-			if((D_EQUAL(min_timestamp, -1)) || ((min_timestamp > -1) && (evt_time < min_timestamp))) {
-				min_timestamp = evt_time;
-				next = LPS_bound[i]->lid;
+			if(efficiency < WINDOW_LOW_EFFICIENCY || rollbacks / events > WINDOW_HIGH_ROLLBACKS) {
+				time_window = max(time_window / 2, rootsim_config.time_window / WINDOW_RANGE);
+			} else if(efficiency > WINDOW_HIGH_EFFICIENCY && window_throttled) {
+				time_window = min(time_window * 2, rootsim_config.time_window * WINDOW_RANGE);
 			}
 		}
 	}
 
+	if(gvt > window_gvt) {
+		window_horizon = gvt + time_window;
+	} else {
+		window_horizon = INFTY;
+	}
+
+	window_gvt = gvt;
+	window_throttled = false;
+}
+
+
+
+/**
+* Notify the scheduler that the next event or the execution state of a LP bound
+* to the calling worker thread might have changed. The LP's key is recomputed
+* and its position in the ready queue is fixed in O(log n).
+*
+* @param lid The local id of the LP to update
+*/
+void stf_update_LP(unsigned int lid) {
+	unsigned int pos = LPS[lid]->ready_idx;
+	simtime_t old_key;
+
+	if(pos >= ready_queue_size || ready_queue[pos].lp != LPS[lid]) {
+		return;
+	}
+
+	old_key = ready_queue[pos].key;
+	ready_queue[pos].key = ready_key(LPS[lid]);
+
+	if(ready_queue[pos].key < old_key) {
+		ready_sift_up(pos);
+	} else {
+		ready_sift_down(pos);
+	}
+}
+
+
+
+/**
+* This function returns the smallest timestamp of the next events of the LPs bound
+* to the calling worker thread, regardless of the optimism window. LPs which are
+* blocked are not accounted for.
+*
+* @return The smallest next-event timestamp, or INFTY if no LP has events to process
+*/
+simtime_t stf_min_timestamp(void) {
+	if(ready_queue_size == 0) {
+		return INFTY;
+	}
+
+	return ready_queue[0].key;
+}
+
+
+
+/**
+* This function implements the smallest timestamp first algorithm. The LP
+* with the smallest next-event timestamp is kept at the top of the ready queue,
+* so the selection takes constant time. If optimism is throttled, no LP is
+* returned when the smallest timestamp is beyond the optimism window.
+*
+* @author Francesco Quaglia
+*
+* @return The Id of the Logical Process qith the smallest timestamp
+*/
+unsigned int smallest_timestamp_first(void) {
+
 	// Return the process to execute
-	if(D_EQUAL(min_timestamp, -1)) {
+	if(ready_queue_size == 0 || D_EQUAL(ready_queue[0].key, INFTY)) {
+		return IDLE_PROCESS;
+	}
+
+	// Events beyond the optimism window wait for the GVT to move forward. Rollbacks are never delayed
+	if(ready_queue[0].key > window_horizon && ready_queue[0].lp->state != LP_STATE_ROLLBACK) {
+		window_throttled = true;
 		return IDLE_PROCESS;
-	} else {
-		return next;
 	}
 
+	return ready_queue[0].lp->lid;
 }
 
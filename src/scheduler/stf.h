@@ -28,7 +28,23 @@
 #ifndef _STF_H
 #define _STF_H
 
+/// Efficiency (committed over processed events) below which the adaptive optimism window shrinks
+#define WINDOW_LOW_EFFICIENCY	0.5
+
+/// Efficiency above which the adaptive optimism window grows, if it has held back some event
+#define WINDOW_HIGH_EFFICIENCY	0.8
+
+/// Rollbacks per processed event above which the adaptive optimism window shrinks
+#define WINDOW_HIGH_ROLLBACKS	0.1
+
+/// The adaptive optimism window is kept within this factor of the initial one
+#define WINDOW_RANGE		64
+
 extern unsigned int smallest_timestamp_first(void);
+extern void stf_rebuild_ready_queue(void);
+extern void stf_update_LP(unsigned int lid);
+extern void stf_update_time_window(simtime_t gvt);
+extern simtime_t stf_min_timestamp(void);
 
 #endif /* _SFT_H */
 
@@ -10,6 +10,7 @@
 #include <core/timer.h>
 #include <mm/malloc.h>
 #include <datatypes/calqueue.h>
+#include <communication/communication.h>
 
 #ifdef EXTRA_CHECKS
 #include <queues/xxhash.h>
@@ -33,10 +34,6 @@ void SerialScheduleNewEvent(unsigned int rcv, simtime_t stamp, unsigned int even
 		rootsim_error(true, "LP %d is trying to send events in the past. Current time: %f, scheduled time: %f\n", current_lp, current_lvt, stamp);
 	}
 
-	if(event_size > MAX_EVENT_SIZE) {
-		rootsim_error(true, "Trying to schedule an event too large. Maximum size is %d, requested is %d. Recompile changing MAX_EVENT_SIZE\n", MAX_EVENT_SIZE, event_size);
-	}
-
 	// Populate the message data structure
 	event = rsalloc(sizeof(msg_t));
 	bzero(event, sizeof(msg_t));
@@ -46,7 +43,7 @@ void SerialScheduleNewEvent(unsigned int rcv, simtime_t stamp, unsigned int even
 	event->send_time = current_lvt;
 	event->type = event_type;
 	event->size = event_size;
-	memcpy(event->event_content, event_content, event_size);
+	msg_set_content(event, event_content, event_size);
 
 	// Put the event in the Calenda Queue
 	calqueue_put(stamp, event);
@@ -117,21 +114,21 @@ void serial_simulation(void) {
 
 		#ifdef EXTRA_CHECKS
 		if(event->size > 0) {
-	                hash1 = XXH64(event->event_content, event->size, current_lp);
+	                hash1 = XXH64(msg_content(event), event->size, current_lp);
 		}
                 #endif
 
 		current_lp = event->receiver;
 		current_lvt = event->timestamp;
 		timer_start(serial_event_execution);
-		ProcessEvent_light(current_lp, current_lvt, event->type, event->event_content, event->size, serial_states[current_lp]);
+		ProcessEvent_light(current_lp, current_lvt, event->type, msg_content(event), event->size, serial_states[current_lp]);
 
 		statistics_post_lp_data(current_lp, STAT_EVENT, 1.0);
 		statistics_post_lp_data(current_lp, STAT_EVENT_TIME, timer_value_seconds(serial_event_execution) );
 
 		#ifdef EXTRA_CHECKS
 		if(event->size > 0) {
-                	hash2 = XXH64(event->event_content, event->size, current_lp);
+                	hash2 = XXH64(msg_content(event), event->size, current_lp);
 		}
 
                 if(hash1 != hash2) {
@@ -167,6 +164,7 @@ void serial_simulation(void) {
 	                statistics_post_other_data(STAT_GVT_TIME, current_lvt);
 		}
 
+		msg_release_content(event);
 		rsfree(event);
 	}
 
@@ -18,10 +18,12 @@
 #include <gvt/gvt.h>
 #include <statistics/statistics.h>
 #include <queues/queues.h>
+#include <communication/communication.h>
 #include <mm/state.h>
 #include <core/timer.h>
 #include <mm/dymelor.h>
 #include <mm/malloc.h>
+#include <mm/numa.h>
 
 
 /// This is a timer that start during the initialization of statistics subsystem and can be used to know the total simulation time
@@ -38,12 +40,24 @@ static struct stat_t *lp_stats;
 /// Keeps statistics on a per-LP basis in a GVT phase
 static struct stat_t *lp_stats_gvt;
 
+/// Keeps statistics on a per-LP basis for the last completed GVT phase
+static struct stat_t *lp_stats_last_gvt;
+
 /// Keeps statistics on a per-thread basis
 static struct stat_t *thread_stats;
 
 /// Keeps global statistics
 static struct stat_t system_wide_stats;
 
+/// The GVT period (in milliseconds) which led to the last GVT reduction of this thread
+static __thread double gvt_period;
+
+/// Wall-clock time (in milliseconds) taken by the calling thread to adopt the GVT being posted
+static __thread double gvt_latency;
+
+/// Memory (in bytes) reclaimed by fossil collection, and the time (in microseconds) spent on it, in the last GVT interval
+static __thread double fossil_memory, fossil_time;
+
 
 /**
 * This function creates a new file
@@ -199,7 +213,7 @@ static void statistics_start(void) {
 	// Print the header of GVT statistics files
 	if (!rootsim_config.serial && (rootsim_config.stats == STATS_ALL || rootsim_config.stats == STATS_PERF)) {
 		for(i = 0; i < n_cores; i++) {
-			fprintf(thread_files[i][GVT_STAT], "#\"WCT\"\t\"GVT VALUE\"\t\"COMM EVENTS\"\t\"CUMULATED COMM EVENTS\"\t\n");
+			fprintf(thread_files[i][GVT_STAT], "#\"WCT\"\t\"GVT VALUE\"\t\"COMM EVENTS\"\t\"CUMULATED COMM EVENTS\"\t\"GVT PERIOD (ms)\"\t\"GVT LATENCY (ms)\"\t\"EVENT RATE (events/s)\"\t\"FOSSIL RECLAIMED (KB)\"\t\"FOSSIL PAUSE (us)\"\t\n");
 			fflush(thread_files[i][GVT_STAT]);
 		}
 	}
@@ -363,6 +377,9 @@ void statistics_stop(int exit_code) {
 			thread_stats[tid].recovery_time += lp_stats[lid].recovery_time;
 			thread_stats[tid].event_time += lp_stats[lid].event_time;
 			thread_stats[tid].idle_cycles += lp_stats[lid].idle_cycles;
+			thread_stats[tid].antimessages_indexed += lp_stats[lid].antimessages_indexed;
+			thread_stats[tid].antimessages_scanned += lp_stats[lid].antimessages_scanned;
+			thread_stats[tid].remote_messages += lp_stats[lid].remote_messages;
 		}
 
 		// Compute derived statistics and dump everything
@@ -387,6 +404,8 @@ void statistics_stop(int exit_code) {
 		fprintf(f, "TOTAL REPROCESSED EVENTS... : %.0f \n", 		thread_stats[tid].reprocessed_events);
 		fprintf(f, "TOTAL ROLLBACKS EXECUTED... : %.0f \n", 		thread_stats[tid].tot_rollbacks);
 		fprintf(f, "TOTAL ANTIMESSAGES......... : %.0f \n", 		thread_stats[tid].tot_antimessages);
+		fprintf(f, "  MATCHED BY INDEX......... : %.0f \n", 		thread_stats[tid].antimessages_indexed);
+		fprintf(f, "  MATCHED BY QUEUE SCAN.... : %.0f \n", 		thread_stats[tid].antimessages_scanned);
 		fprintf(f, "ROLLBACK FREQUENCY......... : %.2f %%\n",		rollback_frequency * 100);
 		fprintf(f, "ROLLBACK LENGTH............ : %.2f events\n",	rollback_length);
 		fprintf(f, "EFFICIENCY................. : %.2f %%\n",		efficiency);
@@ -397,6 +416,11 @@ void statistics_stop(int exit_code) {
 		fprintf(f, "IDLE CYCLES................ : %.0f\n",		thread_stats[tid].idle_cycles);
 		fprintf(f, "NUMBER OF GVT REDUCTIONS... : %.0f\n",		thread_stats[tid].gvt_computations);
 		fprintf(f, "AVERAGE MEMORY USAGE....... : %s\n",		format_size(thread_stats[tid].memory_usage / thread_stats[tid].gvt_computations));
+		if(rootsim_config.numa) {
+			fprintf(f, "NUMA NODE.................. : %d\n",		numa_node);
+			fprintf(f, "REMOTE MESSAGES............ : %.0f\n",		thread_stats[tid].remote_messages);
+			fprintf(f, "REMOTE STATE PAGES......... : %.2f %%\n",	(thread_stats[tid].sampled_pages > 0 ? thread_stats[tid].remote_pages / thread_stats[tid].sampled_pages * 100 : 0));
+		}
 
 		if(exit_code == EXIT_FAILURE) {
 			fprintf(f, "\n--------- SIMULATION ABNORMALLY TERMINATED ----------\n");
@@ -431,6 +455,11 @@ void statistics_stop(int exit_code) {
 				system_wide_stats.recovery_time += thread_stats[i].recovery_time;
 				system_wide_stats.event_time += thread_stats[i].event_time;
 				system_wide_stats.idle_cycles += thread_stats[i].idle_cycles;
+				system_wide_stats.antimessages_indexed += thread_stats[i].antimessages_indexed;
+				system_wide_stats.antimessages_scanned += thread_stats[i].antimessages_scanned;
+				system_wide_stats.remote_messages += thread_stats[i].remote_messages;
+				system_wide_stats.sampled_pages += thread_stats[i].sampled_pages;
+				system_wide_stats.remote_pages += thread_stats[i].remote_pages;
 				system_wide_stats.memory_usage += thread_stats[i].memory_usage;
 			}
 			// GVT computations are the same for all threads
@@ -468,6 +497,8 @@ void statistics_stop(int exit_code) {
 			fprintf(f, "TOTAL REPROCESSED EVENTS... : %.0f \n", 		system_wide_stats.reprocessed_events);
 			fprintf(f, "TOTAL ROLLBACKS EXECUTED... : %.0f \n", 		system_wide_stats.tot_rollbacks);
 			fprintf(f, "TOTAL ANTIMESSAGES......... : %.0f \n", 		system_wide_stats.tot_antimessages);
+			fprintf(f, "  MATCHED BY INDEX......... : %.0f \n", 		system_wide_stats.antimessages_indexed);
+			fprintf(f, "  MATCHED BY QUEUE SCAN.... : %.0f \n", 		system_wide_stats.antimessages_scanned);
 			fprintf(f, "ROLLBACK FREQUENCY......... : %.2f %%\n",		rollback_frequency * 100);
 			fprintf(f, "ROLLBACK LENGTH............ : %.2f events\n",	rollback_length);
 			fprintf(f, "EFFICIENCY................. : %.2f %%\n",		efficiency);
@@ -481,6 +512,11 @@ void statistics_stop(int exit_code) {
 			fprintf(f, "NUMBER OF GVT REDUCTIONS... : %.0f\n",		system_wide_stats.gvt_computations);
 			fprintf(f, "AVERAGE MEMORY USAGE....... : %s\n",		format_size(system_wide_stats.memory_usage / system_wide_stats.gvt_computations));
 			fprintf(f, "PEAK MEMORY USAGE.......... : %s\n",		format_size(getPeakRSS()));
+			if(rootsim_config.numa) {
+				fprintf(f, "NUMA NODES................. : %d\n",		numa_nodes);
+				fprintf(f, "REMOTE MESSAGES............ : %.0f\n",		system_wide_stats.remote_messages);
+				fprintf(f, "REMOTE STATE PAGES......... : %.2f %%\n",	(system_wide_stats.sampled_pages > 0 ? system_wide_stats.remote_pages / system_wide_stats.sampled_pages * 100 : 0));
+			}
 
 			if(exit_code == EXIT_FAILURE) {
 				fprintf(f, "\n--------- SIMULATION ABNORMALLY TERMINATED ----------\n");
@@ -513,7 +549,9 @@ static void statistics_flush_gvt(double gvt) {
 	register unsigned int i;
 	unsigned int committed = 0;
 	static __thread unsigned int cumulated = 0;
+	static __thread double last_exec_time = 0.0;
 	double exec_time;
+	double events = 0.0;
 
 	// Dump on file only if required
 	if( rootsim_config.stats != STATS_ALL && rootsim_config.stats != STATS_PERF) {
@@ -522,18 +560,22 @@ static void statistics_flush_gvt(double gvt) {
 
 	exec_time = timer_value_seconds(simulation_timer);
 
-	// Reduce the committed events from all LPs
+	// Reduce the committed and the processed events from all LPs
 	for(i = 0; i < n_prc_per_thread; i++) {
 		committed += lp_stats_gvt[LPS_bound[i]->lid].committed_events;
+		events += lp_stats_gvt[LPS_bound[i]->lid].tot_events;
 	}
 	cumulated += committed;
 
 	// If we are using a higher level of statistics, dump data on file
 	if(rootsim_config.stats == STATS_PERF || rootsim_config.stats == STATS_LP || rootsim_config.stats ==  STATS_ALL) {
 		f = get_file(STAT_PER_THREAD, GVT_STAT);
-		fprintf(f, "%f\t%f\t%d\t%d\n", exec_time, gvt, committed, cumulated);
+		fprintf(f, "%f\t%f\t%d\t%d\t%d\t%d\t%f\t%f\t%d\n", exec_time, gvt, committed, cumulated, (int)gvt_period, (int)gvt_latency,
+			(exec_time > last_exec_time ? events / (exec_time - last_exec_time) : 0.0), fossil_memory / 1024.0, (int)fossil_time);
 		fflush(f);
 	}
+
+	last_exec_time = exec_time;
 }
 
 
@@ -556,13 +598,17 @@ void statistics_init(void) {
 	}
 
 
-	// Master thread directories to keep
-	// statistics from all threads
-	if(master_thread()) {
-		// Purge old output dir if present
+	// Purge old output dir if present. Only the master kernel does this,
+	// the other ones wait for the new directory to be there
+	if(master_kernel() && master_thread()) {
 		_rmdir(rootsim_config.output_dir);
 		_mkdir(rootsim_config.output_dir);
+	}
+	kernels_barrier();
 
+	// Master thread directories to keep
+	// statistics from all threads
+	if(master_thread()) {
 		for(i = 0; i < n_cores; i++) {
 			sprintf(thread_dir, "%s/thread_%d_%d/", rootsim_config.output_dir, kid, i);
 			_mkdir(thread_dir);
@@ -597,6 +643,8 @@ void statistics_init(void) {
 	bzero(lp_stats, n_prc * sizeof(struct stat_t));
 	lp_stats_gvt = rsalloc(n_prc * sizeof(struct stat_t));
 	bzero(lp_stats_gvt, n_prc * sizeof(struct stat_t));
+	lp_stats_last_gvt = rsalloc(n_prc * sizeof(struct stat_t));
+	bzero(lp_stats_last_gvt, n_prc * sizeof(struct stat_t));
 	thread_stats = rsalloc(n_cores * sizeof(struct stat_t));
 	bzero(thread_stats, n_cores * sizeof(struct stat_t));
 }
@@ -627,6 +675,7 @@ void statistics_fini(void) {
 
 	rsfree(thread_stats);
 	rsfree(lp_stats);
+	rsfree(lp_stats_last_gvt);
 }
 
 
@@ -699,6 +748,18 @@ inline void statistics_post_lp_data(unsigned int lid, unsigned int type, double
 				lp_stats_gvt[lid].reprocessed_events += data;
 				break;
 
+			case STAT_ANTIMESSAGE_INDEX:
+				lp_stats_gvt[lid].antimessages_indexed += 1.0;
+				break;
+
+			case STAT_ANTIMESSAGE_SCAN:
+				lp_stats_gvt[lid].antimessages_scanned += 1.0;
+				break;
+
+			case STAT_REMOTE_MSG:
+				lp_stats_gvt[lid].remote_messages += 1.0;
+				break;
+
 			default:
 				rootsim_error(true, "Wrong LP statistics post type: %d. Aborting...\n", type);
 		}
@@ -708,6 +769,7 @@ inline void statistics_post_lp_data(unsigned int lid, unsigned int type, double
 
 inline void statistics_post_other_data(unsigned int type, double data) {
 	register unsigned int i;
+	unsigned int sampled, remote;
 	
 	if(rootsim_config.serial) {
 		switch(type) {
@@ -738,6 +800,25 @@ inline void statistics_post_other_data(unsigned int type, double data) {
 			statistics_start();
 			break;
 
+		// The GVT period which led to the reduction being posted next
+		case STAT_GVT_PERIOD:
+			gvt_period = data;
+			break;
+
+		// The time it took to reduce the GVT being posted next
+		case STAT_GVT_LATENCY:
+			gvt_latency = data;
+			break;
+
+		// What fossil collection did in the GVT interval being posted next
+		case STAT_FOSSIL_MEMORY:
+			fossil_memory = data;
+			break;
+
+		case STAT_FOSSIL_TIME:
+			fossil_time = data;
+			break;
+
 		// Sum up all that happened in the last GVT phase, in case it is required,
 		// dump a line on the corresponding statistics file
 		case STAT_GVT:
@@ -758,9 +839,20 @@ inline void statistics_post_other_data(unsigned int type, double data) {
 				lp_stats[lid].tot_recoveries += lp_stats_gvt[lid].tot_recoveries;
 				lp_stats[lid].recovery_time += lp_stats_gvt[lid].recovery_time;
 				lp_stats[lid].reprocessed_events += lp_stats_gvt[lid].reprocessed_events;
+				lp_stats[lid].antimessages_indexed += lp_stats_gvt[lid].antimessages_indexed;
+				lp_stats[lid].antimessages_scanned += lp_stats_gvt[lid].antimessages_scanned;
+				lp_stats[lid].remote_messages += lp_stats_gvt[lid].remote_messages;
 				thread_stats[tid].memory_usage += (double)getCurrentRSS();
 				thread_stats[tid].gvt_computations += 1.0;
 
+				// Check where the LP's memory is, with NUMA placement
+				if(rootsim_config.numa) {
+					numa_sample_LP(lid, &sampled, &remote);
+					thread_stats[tid].sampled_pages += sampled;
+					thread_stats[tid].remote_pages += remote;
+				}
+
+				memcpy(&lp_stats_last_gvt[lid], &lp_stats_gvt[lid], sizeof(struct stat_t));
 				bzero(&lp_stats_gvt[LPS_bound[i]->lid], sizeof(struct stat_t));
 			}
 			break;
@@ -770,3 +862,65 @@ inline void statistics_post_other_data(unsigned int type, double data) {
 	}
 }
 
+
+/**
+* This function returns the value of a per-LP statistic, as observed in the
+* last completed GVT phase. It is used by the runtime to take decisions which
+* depend on the recent behaviour of LPs (e.g., their load).
+*
+* @param lid The local id of the LP
+* @param type The statistic to query (one of the STAT_* LP post messages)
+* @return The value accumulated by the LP during the last GVT phase
+*/
+inline double statistics_get_lp_data(unsigned int lid, unsigned int type) {
+
+	switch(type) {
+
+		case STAT_ANTIMESSAGE:
+			return lp_stats_last_gvt[lid].tot_antimessages;
+
+		case STAT_EVENT:
+			return lp_stats_last_gvt[lid].tot_events;
+
+		case STAT_EVENT_TIME:
+			return lp_stats_last_gvt[lid].event_time;
+
+		case STAT_COMMITTED:
+			return lp_stats_last_gvt[lid].committed_events;
+
+		case STAT_ROLLBACK:
+			return lp_stats_last_gvt[lid].tot_rollbacks;
+
+		case STAT_CKPT:
+			return lp_stats_last_gvt[lid].tot_ckpts;
+
+		case STAT_CKPT_MEM:
+			return lp_stats_last_gvt[lid].ckpt_mem;
+
+		case STAT_CKPT_TIME:
+			return lp_stats_last_gvt[lid].ckpt_time;
+
+		case STAT_RECOVERY:
+			return lp_stats_last_gvt[lid].tot_recoveries;
+
+		case STAT_RECOVERY_TIME:
+			return lp_stats_last_gvt[lid].recovery_time;
+
+		case STAT_SILENT:
+			return lp_stats_last_gvt[lid].reprocessed_events;
+
+		case STAT_ANTIMESSAGE_INDEX:
+			return lp_stats_last_gvt[lid].antimessages_indexed;
+
+		case STAT_ANTIMESSAGE_SCAN:
+			return lp_stats_last_gvt[lid].antimessages_scanned;
+
+		case STAT_REMOTE_MSG:
+			return lp_stats_last_gvt[lid].remote_messages;
+
+		default:
+			rootsim_error(true, "Wrong LP statistics get type: %d. Aborting...\n", type);
+	}
+
+	return 0.0;
+}
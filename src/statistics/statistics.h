@@ -69,12 +69,19 @@
 #define STAT_EVENT_TIME		10
 #define STAT_IDLE_CYCLES	11
 #define STAT_SILENT		12
+#define STAT_ANTIMESSAGE_INDEX	13
+#define STAT_ANTIMESSAGE_SCAN	14
+#define STAT_REMOTE_MSG		15
 
 
 /* Definition of Global Statistics Post Messages */
 #define STAT_SIM_START		1001
 #define STAT_GVT		1002
 #define STAT_GVT_TIME		1003
+#define STAT_GVT_PERIOD		1004
+#define STAT_GVT_LATENCY	1005
+#define STAT_FOSSIL_MEMORY	1006
+#define STAT_FOSSIL_TIME	1007
 
 
 
@@ -98,6 +105,11 @@ struct stat_t {
 		event_time,
 		idle_cycles,
 		memory_usage,
+		antimessages_indexed,
+		antimessages_scanned,
+		remote_messages,
+		sampled_pages,
+		remote_pages,
 		gvt_computations,
 		gvt_time; // Used only in sequential simulation
 };
@@ -108,6 +120,7 @@ extern void statistics_fini(void);
 extern void statistics_stop(int exit_code);
 extern inline void statistics_post_lp_data(unsigned int lid, unsigned int type, double data);
 extern inline void statistics_post_other_data(unsigned int type, double data);
+extern inline double statistics_get_lp_data(unsigned int lid, unsigned int type);
 
 
 